@@ -0,0 +1,111 @@
+/**
+ * @file benchmarks/bench_io.cpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#include <benchmark/benchmark.h>
+
+#include <cppcoro/http/route_controller.hpp>
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/http/http_chunk_provider.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cppcoro/when_all.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+
+#include <thread>
+
+using namespace cppcoro;
+
+namespace {
+    struct session
+    {
+    };
+
+    using hello_controller_def = http::route_controller<R"(/hello/(\w+))",
+        session,
+        http::string_request,
+        struct hello_controller>;
+
+    struct hello_controller : hello_controller_def
+    {
+        using hello_controller_def::hello_controller_def;
+
+        auto on_get(std::string_view who) -> task<http::string_response> {
+            co_return http::string_response{http::status::HTTP_STATUS_OK, std::string{who}};
+        }
+    };
+
+    /**
+     * @brief An io_service processing events in a background thread.
+     */
+    struct io_thread
+    {
+        io_service ios;
+        std::thread thread{[this] {
+            ios.process_events();
+        }};
+
+        ~io_thread() {
+            ios.stop();
+            thread.join();
+        }
+    };
+}
+
+/**
+ * Read this file through the chunk provider used by file bodies.
+ */
+static void file_chunk_read(benchmark::State &state) {
+    io_thread io;
+    const auto chunk_size = size_t(state.range(0));
+    size_t bytes = 0;
+    for (auto _ : state) {
+        http::read_only_file_chunk_provider provider{io.ios, __FILE__};
+        sync_wait([&]() -> task<> {
+            for co_await (auto chunk : provider.read(chunk_size)) {
+                bytes += chunk.size();
+            }
+        }());
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+}
+
+BENCHMARK(file_chunk_read)->Arg(256)->Arg(4096);
+
+/**
+ * Round trip of a GET request over a loopback keep-alive connection.
+ */
+static void loopback_request(benchmark::State &state) {
+    io_service ios;
+    // the system picks the port: concurrent runs (ie.: alongside the tests) do not collide
+    http::controller_server<session, hello_controller> server{ios, *net::ip_endpoint::from_string("127.0.0.1:0")};
+    std::thread server_thread{[&] {
+        (void) sync_wait(when_all(
+            [&]() -> task<> {
+                auto _ = on_scope_exit([&] {
+                    ios.stop();
+                });
+                co_await server.serve();
+            }(),
+            [&]() -> task<> {
+                ios.process_events();
+                co_return;
+            }()));
+    }};
+    {
+        http::client client{ios};
+        auto conn = sync_wait(client.connect(server.local_endpoint()));
+        for (auto _ : state) {
+            auto response = sync_wait(conn.get("/hello/world"));
+            if (not response or response->status != http::status::HTTP_STATUS_OK) {
+                state.SkipWithError("request failed");
+                break;
+            }
+            benchmark::DoNotOptimize(sync_wait(response->read_body()));
+        }
+    }
+    server.stop();
+    server_thread.join();
+}
+
+BENCHMARK(loopback_request)->UseRealTime();
@@ -0,0 +1,83 @@
+/**
+ * @file benchmarks/bench_messages.cpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#include <benchmark/benchmark.h>
+
+#include <cppcoro/http/http_request.hpp>
+#include <cppcoro/http/http_response.hpp>
+
+#include <string_view>
+
+using namespace cppcoro;
+
+namespace {
+    constexpr std::string_view small_request =
+        "GET /hello/world HTTP/1.1\r\n"
+        "Host: 127.0.0.1:4242\r\n"
+        "\r\n";
+
+    // what a browser sends
+    constexpr std::string_view browser_request =
+        "GET /static/css/main.css?v=42 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/86.0 Safari/537.36\r\n"
+        "Accept: text/css,*/*;q=0.1\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-Mode: no-cors\r\n"
+        "Sec-Fetch-Dest: style\r\n"
+        "Referer: https://www.example.com/index.html\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n"
+        "Cookie: session=3f2a9c1e7b6d4e0f8a1b2c3d4e5f6a7b; theme=dark; consent=1\r\n"
+        "\r\n";
+
+    constexpr std::string_view post_request =
+        "POST /api/items HTTP/1.1\r\n"
+        "Host: api.example.com\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 58\r\n"
+        "\r\n"
+        R"({"name":"benchmark","tags":["a","b","c"],"quantity":1024})";
+
+    void parse(benchmark::State &state, std::string_view input) {
+        http::request_parser parser;
+        for (auto _ : state) {
+            parser.reset();
+            benchmark::DoNotOptimize(parser.parse(input.data(), input.size()));
+            benchmark::DoNotOptimize(parser.url());
+        }
+        state.SetBytesProcessed(int64_t(state.iterations() * input.size()));
+    }
+}
+
+BENCHMARK_CAPTURE(parse, small, small_request);
+BENCHMARK_CAPTURE(parse, browser, browser_request);
+BENCHMARK_CAPTURE(parse, post, post_request);
+
+static void build_response_header(benchmark::State &state) {
+    http::string_response response{http::status::HTTP_STATUS_OK, "Hello world",
+                                   {{"Content-Type", "text/plain"}, {"Server", "cppcoro-http"}}};
+    std::string header;
+    for (auto _ : state) {
+        header.clear();
+        response.build_header(header);
+        benchmark::DoNotOptimize(header.data());
+    }
+}
+
+BENCHMARK(build_response_header);
+
+static void build_request_header(benchmark::State &state) {
+    http::string_request request{http::method::post, "/api/items", R"({"name":"benchmark"})",
+                                 {{"Host", "api.example.com"}, {"Content-Type", "application/json"}}};
+    std::string header;
+    for (auto _ : state) {
+        header.clear();
+        request.build_header(header);
+        benchmark::DoNotOptimize(header.data());
+    }
+}
+
+BENCHMARK(build_request_header);
@@ -0,0 +1,119 @@
+/**
+ * @file benchmarks/bench_routing.cpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#include <benchmark/benchmark.h>
+
+#include <cppcoro/http/route_controller.hpp>
+#include <cppcoro/io_service.hpp>
+
+#include <fmt/format.h>
+
+#include <utility>
+
+using namespace cppcoro;
+
+namespace {
+    struct session
+    {
+    };
+
+    /**
+     * @brief Route of the Nth controller: "/bench/<N>/(\d+)", distinct prefixes for the prefix trie.
+     */
+    template<size_t N>
+    constexpr auto make_route() {
+        char route[] = R"(/bench/000/(\d+))";
+        route[7] = char('0' + N / 100 % 10);
+        route[8] = char('0' + N / 10 % 10);
+        route[9] = char('0' + N % 10);
+        return ctll::fixed_string{route};
+    }
+
+    template<size_t N>
+    struct bench_controller;
+
+    template<size_t N>
+    using bench_controller_def = http::route_controller<make_route<N>(), session, http::string_request,
+                                                        bench_controller<N>>;
+
+    template<size_t N>
+    struct bench_controller : bench_controller_def<N>
+    {
+        explicit bench_controller(io_service &service) : bench_controller_def<N>{service} {}
+
+        void init_request(int id, http::string_request &) {
+            benchmark::DoNotOptimize(id);
+        }
+
+        auto on_get(int id) -> task<http::string_response> {
+            co_return http::string_response{http::status::HTTP_STATUS_OK, std::to_string(id)};
+        }
+    };
+
+    template<size_t...Is>
+    auto make_server_type(std::index_sequence<Is...>) -> http::controller_server<session, bench_controller<Is>...>;
+
+    template<size_t N>
+    using bench_server = decltype(make_server_type(std::make_index_sequence<N>{}));
+
+    /**
+     * @brief A parser holding the headers of a GET request on @a url.
+     */
+    void load(http::request_parser &parser, std::string_view url) {
+        const auto input = fmt::format("GET {} HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", url);
+        parser.parse(input.data(), input.size());
+    }
+}
+
+/**
+ * Regex match and route parameters loading of a single controller.
+ */
+static void match_init_request(benchmark::State &state) {
+    io_service ios;
+    bench_controller<42> controller{ios};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(controller._init_request("/bench/042/123456"));
+    }
+}
+
+BENCHMARK(match_init_request);
+
+/**
+ * Full routing: prefix trie lookup, controller selection and request initialization among @a N controllers.
+ */
+template<size_t N>
+static void prepare(benchmark::State &state) {
+    io_service ios;
+    bench_server<N> server{ios, *net::ip_endpoint::from_string("127.0.0.1:0")};
+    typename bench_server<N>::context_type context;
+    http::request_parser parser;
+    load(parser, fmt::format("/bench/{:03}/123456", N - 1)); // the last registered controller
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.prepare(parser, context));
+    }
+    if (not context.routed) {
+        state.SkipWithError("request not routed");
+    }
+}
+
+BENCHMARK_TEMPLATE(prepare, 1);
+BENCHMARK_TEMPLATE(prepare, 10);
+BENCHMARK_TEMPLATE(prepare, 100);
+
+/**
+ * Unrouted requests are the worst case of the linear regex scan the prefix trie avoids.
+ */
+template<size_t N>
+static void prepare_not_found(benchmark::State &state) {
+    io_service ios;
+    bench_server<N> server{ios, *net::ip_endpoint::from_string("127.0.0.1:0")};
+    typename bench_server<N>::context_type context;
+    http::request_parser parser;
+    load(parser, "/nowhere/123456");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(server.prepare(parser, context));
+    }
+}
+
+BENCHMARK_TEMPLATE(prepare_not_found, 100);
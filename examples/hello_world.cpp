@@ -7,10 +7,13 @@
 #include <cppcoro/http/http_server.hpp>
 #include <cppcoro/http/route_controller.hpp>
 #include <cppcoro/http/http_chunk_provider.hpp>
+#include <cppcoro/http/sharded_server.hpp>
 
 #include <fmt/printf.h>
 
+#include <atomic>
 #include <csignal>
+#include <pthread.h>
 #include <iostream>
 #include <thread>
 
@@ -75,17 +78,6 @@ using hello_server = http::controller_server<session,
     add_controller,
     cat_controller>;
 
-std::optional<hello_server> g_server;
-
-void at_exit(int) {
-    fmt::print("exit requested\n");
-    if (g_server) {
-        fmt::print("stopping server\n");
-        g_server->stop();
-        fmt::print("done\n");
-    }
-}
-
 int main(const int argc, const char **argv) {
 
     http::logging::log_level = spdlog::level::debug;
@@ -96,47 +88,40 @@ int main(const int argc, const char **argv) {
     auto server_endpoint = net::ip_endpoint::from_string(args.empty() ? "127.0.0.1:4242" : args.at(0));
     fmt::print("listening at '{}'\n", server_endpoint->to_string());
 
-    std::signal(SIGTERM, at_exit);
-    std::signal(SIGINT, at_exit);
-
-    io_service service;
+    // termination signals are only received by the signal thread below, where stopping is safe
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
 //#define SINGLE_THREAD
 #ifndef SINGLE_THREAD
     static const constinit int thread_count = 5;
-    std::array<std::thread, thread_count> thread_pool;
-    rng::generate(thread_pool, [&] {
-        return std::thread([&] {
-            service.process_events();
-        });
-    });
+#else
+    static const constinit int thread_count = 1;
 #endif
 
-    auto do_serve = [&]() -> task<> {
-        auto _ = on_scope_exit([&] {
-            service.stop();
-        });
-        g_server.emplace(
-            service,
-            *server_endpoint);
-        co_await g_server->serve();
-    };
-
-    (void) sync_wait(when_all(
-        do_serve()
-//#ifdef SINGLE_THREAD
-        , [&]() -> task<> {
-            service.process_events();
-            co_return;
-        }()
-//#endif
-        ));
-
-#ifndef SINGLE_THREAD
-    rng::for_each(thread_pool, [](auto &&th) {
-        th.join();
-    });
-#endif
+    // one pinned io_service per thread, each one serving its own hello_server
+    http::runtime runtime{thread_count, true};
+    http::sharded_server<hello_server> server{runtime, *server_endpoint};
+    std::atomic_bool done = false;
+    std::thread signal_thread{[&] {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        if (not done) {
+            fmt::print("exit requested\n");
+            server.stop();
+        }
+    }};
+    try {
+        server.serve();
+    } catch (std::exception &error) {
+        fmt::print("server error: {}\n", error.what());
+    }
+    done = true;
+    pthread_kill(signal_thread.native_handle(), SIGTERM); // wake it up when stopped by an error
+    signal_thread.join();
 
     std::cout << "Bye !\n";
     return 0;
@@ -1,5 +1,6 @@
 #include <cppcoro/http/route_controller.hpp>
 #include <cppcoro/http/http_chunk_provider.hpp>
+#include <cppcoro/http/sharded_server.hpp>
 #include <cppcoro/sync_wait.hpp>
 #include <cppcoro/when_all.hpp>
 #include <cppcoro/on_scope_exit.hpp>
@@ -157,8 +158,9 @@ using simple_co_server = http::controller_server<session,
 
 int main(int argc, char **argv) {
     bool debug = false;
+    bool pin = false;
     std::string endpoint_input = "127.0.0.1:4242";
-    uint32_t thread_count = std::thread::hardware_concurrency() - 1;
+    uint32_t thread_count = std::thread::hardware_concurrency();
     auto cli
         = lyra::opt(debug)
           ["-d"]["--debug"]
@@ -166,6 +168,9 @@ int main(int argc, char **argv) {
           | lyra::opt(thread_count, "thread_count")
           ["-t"]["--threads"]
               ("Thread count")
+          | lyra::opt(pin)
+          ["-p"]["--pin"]
+              ("Pin each thread on its own cpu")
           | lyra::arg(endpoint_input, "endpoint")
               ("Server endpoint");
     auto result = cli.parse({argc, argv});
@@ -179,33 +184,14 @@ int main(int argc, char **argv) {
         http::logging::log_level = spdlog::level::debug;
     }
 
-    io_service service;
     auto server_endpoint = net::ip_endpoint::from_string(endpoint_input);
 
-    // TODO - fix multithreading
-    std::clamp(thread_count, 1u, 256u);
-
-    spdlog::info("listening at '{}' on {} threads\n", server_endpoint->to_string(), thread_count + 1);
-
-    std::vector<std::thread> tp{thread_count};
-
-    rng::generate(tp, [&service] {
-        return std::thread{[&service]() mutable {
-            service.process_events();
-        }};
-    });
-    (void) sync_wait(when_all([&]() -> task<> {
-        auto _ = on_scope_exit([&] {
-            service.stop();
-        });
-        simple_co_server server{service, *server_endpoint};
-        co_await server.serve();
-    }(), [&]() -> task<> {
-        service.process_events();
-        co_return;
-    }()));
-
-    rng::for_each(tp, [](auto &&thread) {
-        thread.join();
-    });
+    thread_count = std::clamp(thread_count, 1u, 256u);
+
+    spdlog::info("listening at '{}' on {} threads\n", server_endpoint->to_string(), thread_count);
+
+    // one io_service per thread, each one running its own simple_co_server
+    http::runtime runtime{thread_count, pin};
+    http::sharded_server<simple_co_server> server{runtime, *server_endpoint};
+    server.serve();
 }
@@ -0,0 +1,175 @@
+/**
+ * @file cppcoro/details/arena.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace cppcoro::detail {
+
+    /**
+     * @brief Size-class pool carved out of a few large blocks.
+     *
+     * Allocations are rounded up to a power of two, released chunks go to the free list of their size class and
+     * are reused by the next allocations of that class, even when other allocations are still alive: the arena
+     * never holds more than the peak of its live allocations.
+     * It is rewound wholesale once all its allocations are released.
+     *
+     * Blocks are kept across rewinds: once warmed up, allocating from an arena never hits the global allocator.
+     * Allocations larger than max_chunk_size (or over-aligned) bypass the arena.
+     * Not thread-safe, an arena belongs to a single connection (see synchronized_arena).
+     */
+    class arena : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t default_block_size = 16 * 1024;
+        static constexpr size_t min_chunk_size = 64;
+        static constexpr size_t max_chunk_size = 64 * 1024;
+        static constexpr size_t chunk_alignment = min_chunk_size;
+
+        explicit arena(size_t block_size = default_block_size) noexcept
+            : block_size_{block_size} {}
+
+        arena(const arena &) = delete;
+
+        arena &operator=(const arena &) = delete;
+
+        /**
+         * @brief Number of allocations not released yet.
+         */
+        [[nodiscard]] size_t live_count() const noexcept {
+            return live_count_;
+        }
+
+        /**
+         * @brief Bytes reserved by the arena.
+         */
+        [[nodiscard]] size_t capacity() const noexcept {
+            size_t result = 0;
+            for (auto &block : blocks_) {
+                result += block.size;
+            }
+            return result;
+        }
+
+    protected:
+        void *do_allocate(size_t size, size_t alignment) override {
+            void *ptr;
+            if (size > max_chunk_size or alignment > chunk_alignment) {
+                ptr = ::operator new(size, std::align_val_t{alignment});
+            } else if (auto &free_list = free_lists_[size_class(size)]; free_list) {
+                ptr = std::exchange(free_list, free_list->next);
+            } else {
+                ptr = bump(chunk_size(size_class(size)));
+            }
+            ++live_count_;
+            return ptr;
+        }
+
+        void do_deallocate(void *ptr, size_t size, size_t alignment) noexcept override {
+            if (size > max_chunk_size or alignment > chunk_alignment) {
+                ::operator delete(ptr, std::align_val_t{alignment});
+            } else {
+                auto &free_list = free_lists_[size_class(size)];
+                free_list = ::new(ptr) free_chunk{free_list};
+            }
+            if (--live_count_ == 0) {
+                current_ = 0;
+                offset_ = 0;
+                free_lists_.fill(nullptr);
+            }
+        }
+
+        [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+    private:
+        static constexpr size_t class_count = std::bit_width(max_chunk_size / min_chunk_size);
+
+        static constexpr size_t size_class(size_t size) noexcept {
+            return size <= min_chunk_size ? 0 : std::bit_width((size - 1) / min_chunk_size);
+        }
+
+        static constexpr size_t chunk_size(size_t size_class) noexcept {
+            return min_chunk_size << size_class;
+        }
+
+        void *bump(size_t size) {
+            for (; current_ < blocks_.size(); ++current_, offset_ = 0) {
+                auto &block = blocks_[current_];
+                if (block.size - offset_ >= size) {
+                    // chunk sizes are multiples of chunk_alignment: so are offsets
+                    void *ptr = block.data.get() + offset_;
+                    offset_ += size;
+                    return ptr;
+                }
+            }
+            const auto block_size = std::max(block_size_, size);
+            blocks_.push_back({block::pointer{static_cast<std::byte *>(
+                ::operator new[](block_size, std::align_val_t{chunk_alignment}))}, block_size});
+            return bump(size);
+        }
+
+        struct block
+        {
+            struct deleter
+            {
+                void operator()(std::byte *data) const noexcept {
+                    ::operator delete[](data, std::align_val_t{chunk_alignment});
+                }
+            };
+            using pointer = std::unique_ptr<std::byte[], deleter>;
+
+            pointer data;
+            size_t size;
+        };
+
+        struct free_chunk
+        {
+            free_chunk *next;
+        };
+
+        size_t block_size_;
+        std::vector<block> blocks_;
+        size_t current_ = 0;
+        size_t offset_ = 0;
+        size_t live_count_ = 0;
+        std::array<free_chunk *, class_count> free_lists_{};
+    };
+
+    /**
+     * @brief Arena shared by coroutines resumed on several threads.
+     *
+     * ie.: pipelined client requests, which writer and readers may run concurrently on a multi-threaded io_service.
+     */
+    class synchronized_arena final : public arena
+    {
+    public:
+        using arena::arena;
+
+    protected:
+        void *do_allocate(size_t size, size_t alignment) override {
+            std::scoped_lock lock{mutex_};
+            return arena::do_allocate(size, alignment);
+        }
+
+        void do_deallocate(void *ptr, size_t size, size_t alignment) noexcept override {
+            std::scoped_lock lock{mutex_};
+            arena::do_deallocate(ptr, size, alignment);
+        }
+
+    private:
+        std::mutex mutex_;
+    };
+}
@@ -0,0 +1,238 @@
+/**
+ * @file cppcoro/details/timer_wheel.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/async_auto_reset_event.hpp>
+#include <cppcoro/cancellation_source.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace cppcoro::detail {
+
+    /**
+     * @brief Hierarchical timer wheel.
+     *
+     * Arming, re-arming and disarming a timer are O(1), whatever the number of timers. Each level has 64 slots,
+     * a slot of level @e n spanning 64^n ticks: timers are moved down one level at a time as their deadline
+     * gets closer, and expire from the first level.
+     *
+     * An expired timer requests cancellation of its cancellation_source.
+     * The armed() event is set when the wheel gets its first timer: the ticker sleeps while the wheel is empty.
+     */
+    class timer_wheel
+    {
+        static constexpr size_t slot_bits = 6;
+        static constexpr size_t slot_count = size_t(1) << slot_bits;
+        static constexpr size_t slot_mask = slot_count - 1;
+        static constexpr size_t level_count = 4;
+        static constexpr uint64_t max_delta = (uint64_t(1) << (slot_bits * level_count)) - 1;
+
+    public:
+        using clock = std::chrono::steady_clock;
+        using duration = std::chrono::milliseconds;
+
+        class timer
+        {
+        public:
+            explicit timer(cancellation_source &source) noexcept
+                : source_{&source} {}
+
+            timer(const timer &) = delete;
+
+            timer &operator=(const timer &) = delete;
+
+            ~timer() {
+                if (wheel_) {
+                    wheel_->disarm(*this);
+                }
+            }
+
+            [[nodiscard]] bool armed() const noexcept {
+                return slot_ != nullptr;
+            }
+
+        private:
+            friend class timer_wheel;
+
+            cancellation_source *source_;
+            timer_wheel *wheel_ = nullptr;
+            timer **slot_ = nullptr;
+            timer *prev_ = nullptr;
+            timer *next_ = nullptr;
+            uint64_t expiry_ = 0;
+        };
+
+        explicit timer_wheel(duration resolution = std::chrono::milliseconds{100}) noexcept
+            : resolution_{std::max(resolution, duration{1})} {}
+
+        timer_wheel(const timer_wheel &) = delete;
+
+        timer_wheel &operator=(const timer_wheel &) = delete;
+
+        [[nodiscard]] duration resolution() const noexcept {
+            return resolution_;
+        }
+
+        /**
+         * @brief Number of armed timers.
+         */
+        [[nodiscard]] size_t size() const noexcept {
+            std::scoped_lock lock{mutex_};
+            return size_;
+        }
+
+        /**
+         * @brief Set when a timer is armed in the empty wheel.
+         *
+         * Set from the arming thread: its waiter is resumed there.
+         */
+        [[nodiscard]] async_auto_reset_event &armed() noexcept {
+            return armed_;
+        }
+
+        /**
+         * @brief (Re-)arm @a t to expire after @a timeout.
+         */
+        void arm(timer &t, duration timeout) {
+            arm_at(t, clock::now() + timeout);
+        }
+
+        /**
+         * @brief (Re-)arm @a t to expire at @a deadline, on the next tick when already past.
+         */
+        void arm_at(timer &t, clock::time_point deadline) {
+            bool first;
+            {
+                std::scoped_lock lock{mutex_};
+                first = size_ == 0;
+                if (t.slot_) {
+                    unlink(t);
+                }
+                if (first) {
+                    // not ticked while empty: catch up with the clock
+                    now_ = std::max(now_, current_tick());
+                }
+                t.wheel_ = this;
+                t.expiry_ = std::max(tick_of(deadline), now_ + 1);
+                link(t);
+            }
+            if (first) {
+                armed_.set();
+            }
+        }
+
+        void disarm(timer &t) noexcept {
+            std::scoped_lock lock{mutex_};
+            if (t.slot_) {
+                unlink(t);
+            }
+        }
+
+        /**
+         * @brief Expire the timers which deadline is before @a now.
+         * @return The number of expired timers.
+         */
+        size_t advance(clock::time_point now = clock::now()) {
+            std::scoped_lock lock{mutex_};
+            const auto target = current_tick(now);
+            size_t expired = 0;
+            while (now_ < target) {
+                if (size_ == 0) {
+                    now_ = target; // nothing to move down or expire
+                    break;
+                }
+                ++now_;
+                cascade();
+                // expiring a timer may resume (and rearm or destroy) others: pop them one by one
+                auto &slot = levels_[0][now_ & slot_mask];
+                while (slot) {
+                    auto &t = *slot;
+                    unlink(t);
+                    ++expired;
+                    t.source_->request_cancellation();
+                }
+            }
+            return expired;
+        }
+
+    private:
+        // last tick at or before time
+        uint64_t current_tick(clock::time_point time = clock::now()) const noexcept {
+            return time <= start_ ? 0 : uint64_t((time - start_) / resolution_);
+        }
+
+        // first tick at or after time
+        uint64_t tick_of(clock::time_point time) const noexcept {
+            if (time <= start_) {
+                return 0;
+            }
+            return uint64_t((time - start_ + resolution_ - clock::duration{1}) / resolution_);
+        }
+
+        void cascade() {
+            // higher levels first, so that their timers go all the way down
+            size_t level = 1;
+            while (level < level_count and ((now_ >> (slot_bits * level)) << (slot_bits * level)) == now_) {
+                ++level;
+            }
+            while (--level > 0) {
+                auto &slot = levels_[level][(now_ >> (slot_bits * level)) & slot_mask];
+                auto *head = slot;
+                slot = nullptr;
+                while (head) {
+                    auto *t = head;
+                    head = t->next_;
+                    t->slot_ = nullptr;
+                    --size_;
+                    link(*t);
+                }
+            }
+        }
+
+        void link(timer &t) noexcept {
+            const auto delta = std::min(t.expiry_ - now_, max_delta);
+            const auto expiry = now_ + delta;
+            size_t level = 0;
+            while (delta >> (slot_bits * (level + 1))) {
+                ++level;
+            }
+            auto &slot = levels_[level][(expiry >> (slot_bits * level)) & slot_mask];
+            t.slot_ = &slot;
+            t.prev_ = nullptr;
+            t.next_ = slot;
+            if (slot) {
+                slot->prev_ = &t;
+            }
+            slot = &t;
+            ++size_;
+        }
+
+        void unlink(timer &t) noexcept {
+            if (t.prev_) {
+                t.prev_->next_ = t.next_;
+            } else {
+                *t.slot_ = t.next_;
+            }
+            if (t.next_) {
+                t.next_->prev_ = t.prev_;
+            }
+            t.slot_ = nullptr;
+            t.prev_ = t.next_ = nullptr;
+            --size_;
+        }
+
+        const duration resolution_;
+        const clock::time_point start_ = clock::now();
+        uint64_t now_ = 0;
+        size_t size_ = 0;
+        std::array<std::array<timer *, slot_count>, level_count> levels_{};
+        mutable std::recursive_mutex mutex_; // recursive: expiring a timer may re-enter the wheel
+        async_auto_reset_event armed_;
+    };
+}
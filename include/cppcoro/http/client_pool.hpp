@@ -0,0 +1,169 @@
+/**
+ * @file cppcoro/http/client_pool.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/async_auto_reset_event.hpp>
+#include <cppcoro/task.hpp>
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace cppcoro::http {
+
+    /**
+     * @brief Client connection limits of a client_pool, per endpoint.
+     */
+    struct pool_limits
+    {
+        size_t max_idle = 8; ///< connections kept open for reuse
+        size_t max_per_host = 32; ///< open connections, leased or idle
+    };
+
+    /**
+     * @brief Keep-alive client connections, reused per endpoint.
+     *
+     * Not thread-safe: use one pool per io_service thread.
+     */
+    class client_pool
+    {
+        struct host
+        {
+            std::vector<client::connection_type> idle;
+            size_t open = 0;
+            async_auto_reset_event released;
+        };
+
+    public:
+        using connection_type = client::connection_type;
+
+        /**
+         * @brief A pooled connection, given back to the pool on destruction.
+         */
+        class lease
+        {
+        public:
+            lease(lease &&other) noexcept
+                : pool_{std::exchange(other.pool_, nullptr)}, host_{other.host_},
+                  connection_{std::move(other.connection_)} {}
+
+            lease(const lease &) = delete;
+
+            lease &operator=(const lease &) = delete;
+
+            ~lease() {
+                if (pool_) {
+                    pool_->release(*host_, std::move(connection_), reusable_);
+                }
+            }
+
+            connection_type &operator*() noexcept { return *connection_; }
+
+            connection_type *operator->() noexcept { return &*connection_; }
+
+            /**
+             * @brief Close the connection instead of giving it back (ie.: broken exchange, Connection: close).
+             */
+            void discard() noexcept {
+                reusable_ = false;
+            }
+
+        private:
+            friend class client_pool;
+
+            lease(client_pool &pool, host &host, connection_type &&connection)
+                : pool_{&pool}, host_{&host}, connection_{std::move(connection)} {}
+
+            client_pool *pool_;
+            host *host_;
+            std::optional<connection_type> connection_;
+            bool reusable_ = true;
+        };
+
+        explicit client_pool(client &client, pool_limits limits = {})
+            : client_{client}, limits_{limits} {}
+
+        client_pool(const client_pool &) = delete;
+
+        client_pool &operator=(const client_pool &) = delete;
+
+        /**
+         * @brief Get a connection to @a endpoint.
+         *
+         * An idle connection still alive is reused, otherwise a new one is opened.
+         * Waits for a connection to be released when @e max_per_host connections are open.
+         */
+        task<lease> acquire(const net::ip_endpoint &endpoint) {
+            auto &h = host_of(endpoint);
+            bool waited = false;
+            while (true) {
+                while (not h.idle.empty()) {
+                    auto conn = std::move(h.idle.back());
+                    h.idle.pop_back();
+                    if (conn.alive()) {
+                        wake_next(h, waited);
+                        co_return lease{*this, h, std::move(conn)};
+                    }
+                    --h.open; // closed by the peer meanwhile
+                }
+                if (h.open < limits_.max_per_host) {
+                    ++h.open;
+                    std::optional<connection_type> conn;
+                    try {
+                        conn.emplace(co_await client_.connect(endpoint));
+                    } catch (...) {
+                        --h.open;
+                        h.released.set();
+                        throw;
+                    }
+                    wake_next(h, waited);
+                    co_return lease{*this, h, std::move(*conn)};
+                }
+                waited = true;
+                co_await h.released;
+            }
+        }
+
+        /**
+         * @brief Idle connections to @a endpoint.
+         */
+        [[nodiscard]] size_t idle(const net::ip_endpoint &endpoint) const {
+            auto it = hosts_.find(endpoint);
+            return it == hosts_.end() ? 0 : it->second->idle.size();
+        }
+
+    private:
+        host &host_of(const net::ip_endpoint &endpoint) {
+            auto &h = hosts_[endpoint];
+            if (not h) {
+                h = std::make_unique<host>();
+            }
+            return *h;
+        }
+
+        // a released slot was taken by a waiter, others may still be served
+        void wake_next(host &h, bool waited) {
+            if (waited and (not h.idle.empty() or h.open < limits_.max_per_host)) {
+                h.released.set();
+            }
+        }
+
+        void release(host &h, std::optional<connection_type> &&conn, bool reusable) {
+            if (conn and reusable and not conn->has_pending_input() and h.idle.size() < limits_.max_idle) {
+                h.idle.push_back(std::move(*conn));
+            } else {
+                --h.open;
+            }
+            h.released.set();
+        }
+
+        client &client_;
+        pool_limits limits_;
+        std::map<net::ip_endpoint, std::unique_ptr<host>> hosts_; // stable addresses: leases refer to them
+    };
+}
@@ -0,0 +1,76 @@
+/**
+ * @file cppcoro/http/details/codel.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+namespace cppcoro::http::detail {
+
+    /**
+     * @brief CoDel (controlled delay) queue management, applied to requests.
+     *
+     * Nothing is dropped while the queueing delay goes below @e target at least once per @e interval.
+     * Once it stays above, requests are dropped at an increasing rate (interval / sqrt(drop count))
+     * until the delay gets back under the target.
+     *
+     * See: K. Nichols, V. Jacobson, "Controlling Queue Delay", ACM Queue, 2012.
+     */
+    class codel
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+        using duration = clock::duration;
+
+        /**
+         * @brief Whether to drop a request that waited @a sojourn.
+         */
+        bool drop(duration sojourn, duration target, duration interval, clock::time_point now = clock::now()) {
+            std::scoped_lock lock{mutex_};
+            bool ok_to_drop = false;
+            if (sojourn < target) {
+                first_above_time_ = {};
+            } else if (first_above_time_ == clock::time_point{}) {
+                first_above_time_ = now + interval;
+            } else if (now >= first_above_time_) {
+                ok_to_drop = true;
+            }
+
+            if (dropping_) {
+                if (not ok_to_drop) {
+                    dropping_ = false;
+                } else if (now >= drop_next_) {
+                    ++count_;
+                    drop_next_ = control_law(drop_next_, interval);
+                    return true;
+                }
+            } else if (ok_to_drop) {
+                dropping_ = true;
+                // dropping again shortly after: resume near the previous rate
+                count_ = (count_ > 2 and now - drop_next_ < 8 * interval) ? count_ - 2 : 1;
+                drop_next_ = control_law(now, interval);
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool dropping() const noexcept {
+            std::scoped_lock lock{mutex_};
+            return dropping_;
+        }
+
+    private:
+        [[nodiscard]] clock::time_point control_law(clock::time_point t, duration interval) const noexcept {
+            return t + std::chrono::duration_cast<duration>(interval / std::sqrt(double(count_)));
+        }
+
+        mutable std::mutex mutex_;
+        clock::time_point first_above_time_{};
+        clock::time_point drop_next_{};
+        size_t count_ = 0;
+        bool dropping_ = false;
+    };
+}
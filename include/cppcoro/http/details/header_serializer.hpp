@@ -0,0 +1,100 @@
+/**
+ * @file cppcoro/http/details/header_serializer.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/http.hpp>
+
+#include <array>
+#include <charconv>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+namespace cppcoro::http::detail {
+
+    /**
+     * @brief Pre-rendered status lines, indexed by status code.
+     */
+    inline constexpr auto status_lines = [] {
+        std::array<std::string_view, 600> lines;
+        lines.fill(std::string_view{});
+#define CPPCORO_HTTP_STATUS_LINE(num, name, string) \
+        lines[num] = "HTTP/1.1 " #num " " #string "\r\n";
+        HTTP_STATUS_MAP(CPPCORO_HTTP_STATUS_LINE)
+#undef CPPCORO_HTTP_STATUS_LINE
+        return lines;
+    }();
+
+    /**
+     * @brief Pre-rendered status line of @a status, empty when unknown.
+     */
+    constexpr std::string_view status_line(http::status status) noexcept {
+        if (const auto code = size_t(status); code < status_lines.size()) {
+            return status_lines[code];
+        }
+        return {};
+    }
+
+    /**
+     * @brief Current "Date" header line.
+     *
+     * Rendered at most once per second, per thread (ie.: per shard) so no synchronization is needed.
+     */
+    inline std::string_view date_header() noexcept {
+        static constexpr std::string_view days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+        static constexpr std::string_view months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                                      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+        thread_local struct
+        {
+            std::time_t time = -1;
+            std::array<char, 64> line{};
+            size_t size = 0;
+        } cache;
+
+        const auto now = std::time(nullptr);
+        if (now != cache.time) {
+            std::tm tm{};
+            gmtime_r(&now, &tm);
+            auto *out = cache.line.data();
+            auto append = [&out](std::string_view str) {
+                out = std::copy(str.begin(), str.end(), out);
+            };
+            auto append_number = [&out](int value, int width) {
+                for (int ii = width - 1; ii >= 0; --ii, value /= 10) {
+                    out[ii] = char('0' + value % 10);
+                }
+                out += width;
+            };
+            append("Date: ");
+            append(days[tm.tm_wday]);
+            append(", ");
+            append_number(tm.tm_mday, 2);
+            append(" ");
+            append(months[tm.tm_mon]);
+            append(" ");
+            append_number(tm.tm_year + 1900, 4);
+            append(" ");
+            append_number(tm.tm_hour, 2);
+            append(":");
+            append_number(tm.tm_min, 2);
+            append(":");
+            append_number(tm.tm_sec, 2);
+            append(" GMT\r\n");
+            cache.size = size_t(out - cache.line.data());
+            cache.time = now;
+        }
+        return {cache.line.data(), cache.size};
+    }
+
+    inline void append_number(std::string &output, size_t value) {
+        std::array<char, 24> buffer;
+        auto end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value).ptr;
+        output.append(buffer.data(), end);
+    }
+
+    inline void append_header(std::string &output, std::string_view field, std::string_view value) {
+        output.append(field).append(": ").append(value).append("\r\n");
+    }
+}
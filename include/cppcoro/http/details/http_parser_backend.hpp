@@ -0,0 +1,122 @@
+/**
+ * @file cppcoro/http/details/http_parser_backend.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/http.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace cppcoro::http::detail {
+
+    /**
+     * @brief nodejs/http_parser backend.
+     *
+     * Drives the handler's on_* callbacks from http_parser's, pausing at the end of each message.
+     */
+    template <bool is_request>
+    class http_parser_backend {
+    public:
+        http_parser_backend() noexcept {
+            http_parser_init(&parser_, is_request ? HTTP_REQUEST : HTTP_RESPONSE);
+        }
+
+        template <typename HandlerT>
+        size_t execute(HandlerT &handler, const char *data, size_t len) {
+            parser_.data = &handler;
+            const auto count = http_parser_execute(&parser_, &settings<HandlerT>, data, len);
+            if (const auto error = http_errno(parser_.http_errno);
+                error == HPE_PAUSED) {
+                http_parser_pause(&parser_, 0);
+            } else if (error != HPE_OK) {
+                throw std::runtime_error{
+                    std::string("parse error: ") + http_errno_description(error)
+                };
+            }
+            return count;
+        }
+
+        auto method() const noexcept {
+            return static_cast<http::method>(parser_.method);
+        }
+
+        auto status_code() const noexcept {
+            return static_cast<http::status>(parser_.status_code);
+        }
+
+    private:
+        template <typename HandlerT>
+        static auto &handler(http_parser *parser) {
+            return *static_cast<HandlerT *>(parser->data);
+        }
+
+        template <typename HandlerT>
+        static int on_message_begin(http_parser *parser) {
+            handler<HandlerT>(parser).on_message_begin();
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_url(http_parser *parser, const char *data, size_t len) {
+            handler<HandlerT>(parser).on_url({data, len});
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_status(http_parser *parser, const char *data, size_t len) {
+            handler<HandlerT>(parser).on_status({data, len});
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_header_field(http_parser *parser, const char *data, size_t len) {
+            handler<HandlerT>(parser).on_header_field({data, len});
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_header_value(http_parser *parser, const char *data, size_t len) {
+            handler<HandlerT>(parser).on_header_value({data, len});
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_headers_complete(http_parser *parser) {
+            handler<HandlerT>(parser).on_headers_complete();
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_body(http_parser *parser, const char *data, size_t len) {
+            handler<HandlerT>(parser).on_body({data, len});
+            return 0;
+        }
+
+        template <typename HandlerT>
+        static int on_message_complete(http_parser *parser) {
+            handler<HandlerT>(parser).on_message_complete();
+            // stop here, following bytes are not part of this message
+            http_parser_pause(parser, 1);
+            return 0;
+        }
+
+        template <typename HandlerT>
+        inline static http_parser_settings settings = {
+            on_message_begin<HandlerT>,
+            on_url<HandlerT>,
+            on_status<HandlerT>,
+            on_header_field<HandlerT>,
+            on_header_value<HandlerT>,
+            on_headers_complete<HandlerT>,
+            on_body<HandlerT>,
+            on_message_complete<HandlerT>,
+            nullptr, // on_chunk_header
+            nullptr, // on_chunk_complete
+        };
+
+        http_parser parser_{};
+    };
+}
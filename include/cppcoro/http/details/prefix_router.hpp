@@ -0,0 +1,159 @@
+/**
+ * @file cppcoro/http/details/prefix_router.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <ctll.hpp>
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+namespace cppcoro::http::detail {
+
+    /**
+     * @brief Literal prefix of a route regex.
+     *
+     * Every url matched by the route starts with it. The prefix stops at the first regex construct,
+     * a quantified last character is left out and routes with a top-level alternation get an empty prefix.
+     */
+    template<ctll::fixed_string route>
+    constexpr auto make_route_prefix() {
+        struct prefix_type
+        {
+            std::array<char, route.size() + 1> data{};
+            size_t size = 0;
+
+            [[nodiscard]] constexpr std::string_view view() const {
+                return {data.data(), size};
+            }
+        } prefix;
+
+        constexpr auto is_special = [](char32_t c) {
+            return std::u32string_view{U"\\^$.|?*+()[]{}"}.find(c) != std::u32string_view::npos;
+        };
+
+        // top-level alternation: no common prefix
+        int depth = 0;
+        for (size_t ii = 0; ii < route.size(); ++ii) {
+            const auto c = route[ii];
+            if (c == '\\') {
+                ++ii;
+            } else if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                --depth;
+            } else if (c == '|' and depth == 0) {
+                return prefix;
+            }
+        }
+
+        size_t ii = 0;
+        for (; ii < route.size() and not is_special(route[ii]) and route[ii] < 0x80; ++ii) {
+            prefix.data[prefix.size++] = char(route[ii]);
+        }
+        if (ii < route.size() and prefix.size
+            and (route[ii] == '?' or route[ii] == '*' or route[ii] == '{')) {
+            --prefix.size; // optional last character
+        }
+        return prefix;
+    }
+
+    /**
+     * @brief Compile-time trie of route prefixes.
+     *
+     * Walking an url down the trie gives the set of routes which prefix it starts with,
+     * in a single pass whatever the number of routes.
+     */
+    template<size_t max_nodes, size_t route_count>
+    class prefix_trie
+    {
+        static constexpr size_t word_count = (route_count + 63) / 64;
+
+    public:
+        using candidates_type = std::array<uint64_t, word_count>;
+
+        constexpr void insert(std::string_view prefix, size_t route) {
+            size_t current = 0;
+            for (char c : prefix) {
+                auto child = nodes_[current].first_child;
+                while (child and nodes_[child].c != c) {
+                    child = nodes_[child].next_sibling;
+                }
+                if (not child) {
+                    child = size_++;
+                    nodes_[child].c = c;
+                    nodes_[child].next_sibling = nodes_[current].first_child;
+                    nodes_[current].first_child = child;
+                }
+                current = child;
+            }
+            nodes_[current].routes[route / 64] |= uint64_t(1) << (route % 64);
+        }
+
+        /**
+         * @brief Routes which prefix @a url starts with.
+         */
+        [[nodiscard]] constexpr candidates_type candidates(std::string_view url) const {
+            candidates_type result = nodes_[0].routes;
+            size_t current = 0;
+            for (char c : url) {
+                auto child = nodes_[current].first_child;
+                while (child and nodes_[child].c != c) {
+                    child = nodes_[child].next_sibling;
+                }
+                if (not child) {
+                    break;
+                }
+                current = child;
+                for (size_t word = 0; word < word_count; ++word) {
+                    result[word] |= nodes_[current].routes[word];
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Call @a fn with each candidate route index of @a url, in ascending order, until it returns true.
+         * @return true when stopped by @a fn.
+         */
+        template<typename FnT>
+        constexpr bool visit(std::string_view url, FnT &&fn) const {
+            const auto routes = candidates(url);
+            for (size_t word = 0; word < word_count; ++word) {
+                for (auto bits = routes[word]; bits; bits &= bits - 1) {
+                    if (fn(word * 64 + size_t(std::countr_zero(bits)))) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+    private:
+        struct node
+        {
+            char c = 0;
+            size_t first_child = 0; // 0: none (the root is never a child)
+            size_t next_sibling = 0;
+            std::array<uint64_t, word_count> routes{};
+        };
+
+        std::array<node, max_nodes> nodes_{};
+        size_t size_ = 1;
+    };
+
+    /**
+     * @brief Build the prefix trie of @a prefixes (one route per prefix, in order).
+     */
+    template<size_t max_nodes, size_t route_count>
+    constexpr auto make_prefix_trie(const std::array<std::string_view, route_count> &prefixes) {
+        prefix_trie<max_nodes, route_count> trie;
+        for (size_t ii = 0; ii < route_count; ++ii) {
+            trie.insert(prefixes[ii], ii);
+        }
+        return trie;
+    }
+}
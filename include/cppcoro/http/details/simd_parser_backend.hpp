@@ -0,0 +1,428 @@
+/**
+ * @file cppcoro/http/details/simd_parser_backend.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/http.hpp>
+#include <cppcoro/http/http_headers.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE4_2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace cppcoro::http::detail {
+
+    namespace simd {
+
+        /**
+         * @brief First char of [first, last) falling in one of the inclusive @a ranges.
+         *
+         * @a ranges holds up to 8 (low, high) bounds pairs, it must be 16 bytes long (SSE4.2 string instruction).
+         */
+        inline const char *find_in_ranges(const char *first, const char *last,
+                                           const char (&ranges)[16], int ranges_size) noexcept {
+#ifdef __SSE4_2__
+            const auto r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ranges));
+            while (last - first >= 16) {
+                const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+                const auto index = _mm_cmpestri(r, ranges_size, block, 16,
+                                                _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+                if (index != 16) {
+                    return first + index;
+                }
+                first += 16;
+            }
+#endif
+            for (; first != last; ++first) {
+                const auto c = static_cast<unsigned char>(*first);
+                for (int ii = 0; ii < ranges_size; ii += 2) {
+                    if (c >= static_cast<unsigned char>(ranges[ii]) and c <= static_cast<unsigned char>(ranges[ii + 1])) {
+                        return first;
+                    }
+                }
+            }
+            return last;
+        }
+
+        /**
+         * @brief First @a c in [first, last).
+         */
+        inline const char *find_char(const char *first, const char *last, char c) noexcept {
+#ifdef __AVX2__
+            const auto needle = _mm256_set1_epi8(c);
+            while (last - first >= 32) {
+                const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+                if (const auto mask = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+                    mask != 0) {
+                    return first + __builtin_ctz(mask);
+                }
+                first += 32;
+            }
+#endif
+            auto *found = static_cast<const char *>(std::memchr(first, c, size_t(last - first)));
+            return found ? found : last;
+        }
+
+        /**
+         * @brief End of a message head (past its empty line), nullptr when incomplete.
+         */
+        inline const char *find_head_end(const char *first, const char *last) noexcept {
+            for (auto *p = find_char(first, last, '\n'); p != last; p = find_char(p + 1, last, '\n')) {
+                if (last - p > 1 and p[1] == '\n') {
+                    return p + 2;
+                }
+                if (last - p > 2 and p[1] == '\r' and p[2] == '\n') {
+                    return p + 3;
+                }
+            }
+            return nullptr;
+        }
+    }
+
+    /**
+     * @brief SIMD backend.
+     *
+     * picohttpparser-like parser: the head is located with a vectorized scan then parsed in one go,
+     * with SSE4.2 range scans for header names and values. Bodies (identity or chunked) are streamed
+     * to the handler as they arrive. Heads split across segments are accumulated internally.
+     *
+     * Vector paths are enabled by the target flags (-msse4.2, -mavx2), scalar code is used otherwise.
+     * Only the methods known by http::method are recognized, others are reported as http::method::unknown.
+     */
+    template <bool is_request>
+    class simd_parser_backend {
+    public:
+        static constexpr size_t max_head_size = 64 * 1024;
+
+        template <typename HandlerT>
+        size_t execute(HandlerT &handler, const char *data, size_t len) {
+            const char *p = data;
+            const char *end = data + len;
+            while (p != end) {
+                switch (state_) {
+                    case state::done:
+                        reset();
+                        [[fallthrough]];
+                    case state::head: {
+                        const char *head_end;
+                        if (head_buffer_.empty()) {
+                            head_end = simd::find_head_end(p, end);
+                            if (!head_end) {
+                                stash(p, end);
+                                return len;
+                            }
+                            parse_head(handler, {p, size_t(head_end - p)});
+                            p = head_end;
+                        } else {
+                            const auto previous = head_buffer_.size();
+                            head_buffer_.append(p, end);
+                            const auto *buffer = head_buffer_.data();
+                            head_end = simd::find_head_end(buffer + (previous > 2 ? previous - 2 : 0),
+                                                           buffer + head_buffer_.size());
+                            if (!head_end) {
+                                check_head_size();
+                                return len;
+                            }
+                            const auto head_size = size_t(head_end - buffer);
+                            p += head_size - previous;
+                            parse_head(handler, {buffer, head_size});
+                            head_buffer_.clear();
+                        }
+                        if (state_ == state::done) {
+                            return complete(handler, data, p);
+                        }
+                        break;
+                    }
+                    case state::body:
+                    case state::chunk_data: {
+                        const auto size = std::min<uint64_t>(uint64_t(end - p), remaining_);
+                        handler.on_body({p, size_t(size)});
+                        p += size;
+                        remaining_ -= size;
+                        if (remaining_ == 0) {
+                            if (state_ == state::body) {
+                                return complete(handler, data, p);
+                            }
+                            state_ = state::chunk_data_end;
+                        }
+                        break;
+                    }
+                    case state::chunk_size: {
+                        const char c = *p++;
+                        if (const auto digit = hex_digit(c); digit >= 0) {
+                            if (remaining_ >> 60) {
+                                throw_error("chunk size overflow");
+                            }
+                            remaining_ = (remaining_ << 4) | uint64_t(digit);
+                            has_digits_ = true;
+                        } else if (c == ';') {
+                            state_ = state::chunk_extension;
+                        } else if (c == '\n') {
+                            end_of_chunk_size();
+                        } else if (c != '\r') {
+                            throw_error("invalid chunk size");
+                        }
+                        break;
+                    }
+                    case state::chunk_extension: {
+                        auto *lf = simd::find_char(p, end, '\n');
+                        p = lf;
+                        if (lf != end) {
+                            ++p;
+                            end_of_chunk_size();
+                        }
+                        break;
+                    }
+                    case state::chunk_data_end: {
+                        const char c = *p++;
+                        if (c == '\n') {
+                            state_ = state::chunk_size;
+                            has_digits_ = false;
+                        } else if (c != '\r') {
+                            throw_error("invalid chunk delimiter");
+                        }
+                        break;
+                    }
+                    case state::trailer_line_start: {
+                        const char c = *p++;
+                        if (c == '\n') {
+                            return complete(handler, data, p);
+                        }
+                        state_ = c == '\r' ? state::trailer_end : state::trailer_line;
+                        break;
+                    }
+                    case state::trailer_line: {
+                        auto *lf = simd::find_char(p, end, '\n');
+                        p = lf;
+                        if (lf != end) {
+                            ++p;
+                            state_ = state::trailer_line_start;
+                        }
+                        break;
+                    }
+                    case state::trailer_end: {
+                        if (*p++ != '\n') {
+                            throw_error("invalid trailer");
+                        }
+                        return complete(handler, data, p);
+                    }
+                }
+            }
+            return len;
+        }
+
+        auto method() const noexcept {
+            return method_;
+        }
+
+        auto status_code() const noexcept {
+            return static_cast<http::status>(status_code_);
+        }
+
+    private:
+        enum class state
+        {
+            head,
+            body,
+            chunk_size,
+            chunk_extension,
+            chunk_data,
+            chunk_data_end,
+            trailer_line_start,
+            trailer_line,
+            trailer_end,
+            done,
+        };
+
+        [[noreturn]] static void throw_error(const char *what) {
+            throw std::runtime_error{std::string("parse error: ") + what};
+        }
+
+        static int hex_digit(char c) noexcept {
+            if (c >= '0' and c <= '9') return c - '0';
+            if (c >= 'a' and c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' and c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        static http::method to_method(std::string_view token) noexcept {
+            using namespace std::string_view_literals;
+            if (token == "GET"sv) return http::method::get;
+            if (token == "POST"sv) return http::method::post;
+            if (token == "PUT"sv) return http::method::put;
+            if (token == "DELETE"sv) return http::method::del;
+            if (token == "HEAD"sv) return http::method::head;
+            if (token == "OPTIONS"sv) return http::method::options;
+            if (token == "PATCH"sv) return http::method::patch;
+            return http::method::unknown;
+        }
+
+        void reset() noexcept {
+            state_ = state::head;
+            remaining_ = 0;
+            has_digits_ = false;
+            content_length_ = -1;
+            chunked_ = false;
+        }
+
+        void stash(const char *first, const char *last) {
+            head_buffer_.assign(first, last);
+            check_head_size();
+        }
+
+        void check_head_size() const {
+            if (head_buffer_.size() > max_head_size) {
+                throw_error("header overflow");
+            }
+        }
+
+        template <typename HandlerT>
+        size_t complete(HandlerT &handler, const char *data, const char *p) {
+            state_ = state::done;
+            handler.on_message_complete();
+            return size_t(p - data);
+        }
+
+        void end_of_chunk_size() {
+            if (not has_digits_) {
+                throw_error("invalid chunk size");
+            }
+            // the last (empty) chunk is followed by optional trailers
+            state_ = remaining_ ? state::chunk_data : state::trailer_line_start;
+        }
+
+        /**
+         * @brief Next line of @a head (without its line ending).
+         */
+        static std::string_view next_line(std::string_view &head) {
+            auto *first = head.data();
+            auto *lf = simd::find_char(first, first + head.size(), '\n');
+            auto line = std::string_view{first, size_t(lf - first)};
+            head.remove_prefix(std::min(line.size() + 1, head.size()));
+            if (not line.empty() and line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            return line;
+        }
+
+        static std::string_view trim(std::string_view value) noexcept {
+            const auto first = value.find_first_not_of(" \t");
+            if (first == std::string_view::npos) {
+                return {};
+            }
+            return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+        }
+
+        static std::string_view next_token(std::string_view &line) {
+            const auto pos = line.find(' ');
+            auto token = line.substr(0, pos);
+            line.remove_prefix(pos == std::string_view::npos ? line.size() : pos + 1);
+            return token;
+        }
+
+        static void check_version(std::string_view version) {
+            if (version.size() != 8 or not version.starts_with("HTTP/1.") or
+                (version[7] != '0' and version[7] != '1')) {
+                throw_error("invalid version");
+            }
+        }
+
+        template <typename HandlerT>
+        void parse_head(HandlerT &handler, std::string_view head) {
+            // names end at ':', anything in [\0-' '] or DEL is invalid
+            alignas(16) static constexpr char name_ranges[16] = "\0 ::\x7f\x7f";
+            // values end at the first control char but tab
+            alignas(16) static constexpr char value_ranges[16] = "\0\x08\n\x1f\x7f\x7f";
+
+            handler.on_message_begin();
+            auto start_line = next_line(head);
+            if constexpr (is_request) {
+                method_ = to_method(next_token(start_line));
+                auto url = next_token(start_line);
+                if (url.empty()) {
+                    throw_error("invalid url");
+                }
+                check_version(start_line);
+                handler.on_url(url);
+            } else {
+                check_version(next_token(start_line));
+                auto code = next_token(start_line);
+                if (code.size() != 3 or
+                    std::from_chars(code.data(), code.data() + code.size(), status_code_).ec != std::errc{}) {
+                    throw_error("invalid status");
+                }
+                handler.on_status(start_line);
+            }
+
+            while (true) {
+                auto line = next_line(head);
+                if (line.empty()) {
+                    break;
+                }
+                auto *first = line.data();
+                auto *last = first + line.size();
+                auto *colon = simd::find_in_ranges(first, last, name_ranges, 6);
+                if (colon == last or *colon != ':' or colon == first) {
+                    throw_error("invalid header field");
+                }
+                std::string_view name{first, size_t(colon - first)};
+                if (simd::find_in_ranges(colon + 1, last, value_ranges, 6) != last) {
+                    throw_error("invalid header value");
+                }
+                auto value = trim({colon + 1, size_t(last - colon - 1)});
+                handler.on_header_field(name);
+                handler.on_header_value(value);
+
+                if (detail::iequals(name, "Content-Length")) {
+                    uint64_t length = 0;
+                    if (std::from_chars(value.data(), value.data() + value.size(), length).ptr != value.data() + value.size()
+                        or value.empty() or (content_length_ >= 0 and uint64_t(content_length_) != length)) {
+                        throw_error("invalid content length");
+                    }
+                    content_length_ = int64_t(length);
+                } else if (detail::iequals(name, "Transfer-Encoding")) {
+                    const auto last_coding = trim(value.substr(value.rfind(',') + 1));
+                    chunked_ = detail::iequals(last_coding, "chunked");
+                }
+            }
+            handler.on_headers_complete();
+
+            if (chunked_ and content_length_ >= 0) {
+                throw_error("both content length and chunked encoding");
+            }
+            const bool no_body = not is_request and
+                                 (status_code_ / 100 == 1 or status_code_ == 204 or status_code_ == 304);
+            if (no_body) {
+                state_ = state::done;
+            } else if (chunked_) {
+                state_ = state::chunk_size;
+                remaining_ = 0;
+                has_digits_ = false;
+            } else if (content_length_ > 0) {
+                state_ = state::body;
+                remaining_ = uint64_t(content_length_);
+            } else {
+                // no length means no body (reading responses until the connection closes is not supported)
+                state_ = state::done;
+            }
+        }
+
+        state state_ = state::head;
+        uint64_t remaining_ = 0;
+        bool has_digits_ = false;
+        int64_t content_length_ = -1;
+        bool chunked_ = false;
+        http::method method_ = http::method::unknown;
+        int status_code_ = 0;
+        std::string head_buffer_;
+    };
+}
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <cppcoro/http/http.hpp>
+#include <cppcoro/http/details/http_parser_backend.hpp>
+#include <cppcoro/http/details/simd_parser_backend.hpp>
 #include <cppcoro/task.hpp>
 #include <cppcoro/async_generator.hpp>
 
 #include <fmt/format.h>
 
 #include <memory>
+#include <vector>
 
 namespace cppcoro::http::detail {
 
@@ -21,6 +24,14 @@ namespace cppcoro::http::detail {
     template<typename BodyT>
     concept rw_chunked_body = ro_chunked_body<BodyT> and wo_chunked_body<BodyT>;
 
+    /**
+     * Chunked bodies backed by a regular file, that can be sent without copies.
+     */
+    template<typename BodyT>
+    concept ro_file_body = ro_chunked_body<BodyT> and requires(BodyT &&body) {
+        { body.path() } -> std::convertible_to<std::string_view>;
+    };
+
     template<typename BodyT>
     concept ro_basic_body = requires(BodyT &&body) {
         { body.data() } -> std::same_as<char *>;
@@ -44,95 +55,167 @@ namespace cppcoro::http::detail {
     template<typename BodyT>
     concept is_body = readable_body<BodyT> or writeable_body<BodyT>;
 
+    /**
+     * Messages which concrete type is known, their body is accessed directly (no virtual call, no coroutine).
+     */
+    template<typename MessageT>
+    concept typed_message = requires(MessageT &message) {
+        typename MessageT::body_type;
+        message.body_access;
+    };
+
+#ifdef CPPCORO_HTTP_SIMD_PARSER
+    template <bool is_request>
+    using default_parser_backend = simd_parser_backend<is_request>;
+#else
     template <bool is_request>
+    using default_parser_backend = http_parser_backend<is_request>;
+#endif
+
+    /**
+     * @brief Static parser handler.
+     *
+     * Accumulates what the parser backend reports, and loads it into messages.
+     * The backend (http_parser_backend or simd_parser_backend) drives the on_* callbacks
+     * and stops at the end of each message.
+     */
+    template <bool is_request, typename BackendT = default_parser_backend<is_request>>
     class static_parser_handler {
-        using self_type = static_parser_handler<is_request>;
+        friend BackendT;
 
     public:
+        using backend_type = BackendT;
+
         static_parser_handler() = default;
-        static_parser_handler(static_parser_handler &&other) noexcept
-            : parser_{std::move(other.parser_)}
-            , header_field_{std::move(other.header_field_)}
-            , state_{std::move(other.state_)} {
-            if (parser_) {
-                parser_->data = this;
-            }
-        }
-        static_parser_handler& operator=(static_parser_handler &&other) noexcept {
-            parser_ = std::move(other.parser_);
-            header_field_ = std::move(other.header_field_);
-            state_ = std::move(other.state_);
-            if (parser_) {
-                parser_->data = this;
-            }
-            return *this;
-        }
+        static_parser_handler(static_parser_handler &&other) noexcept = default;
+        static_parser_handler& operator=(static_parser_handler &&other) noexcept = default;
         static_parser_handler(const static_parser_handler &) noexcept = delete;
         static_parser_handler& operator=(const static_parser_handler &) noexcept = delete;
 
+        /**
+         * @brief Get ready for the next message, keeping allocated storage.
+         */
+        void reset() {
+            backend_ = BackendT{};
+            state_ = status::none;
+            headers_complete_ = false;
+            headers_loaded_ = false;
+            url_.clear();
+            body_.clear();
+            headers_.clear();
+        }
+
+        /**
+         * @brief Body fragments received by the last parse call.
+         */
         bool has_body() const noexcept {
-            return body_.size();
+            return not body_.empty();
+        }
+
+        /**
+         * @brief Url and headers are fully parsed.
+         */
+        bool headers_complete() const noexcept {
+            return headers_complete_;
         }
 
         operator bool() const {
             return state_ == status::on_message_complete;
         }
 
-        const void parse(const char *data, size_t len) {
-            body_ = {};
-            const auto count = execute_parser(data, len);
-            if (count < len) {
-                throw std::runtime_error{
-                    std::string("parse error: ") + http_errno_description(detail::http_errno(parser_->http_errno))
-                };
-            }
-//            if (!parser_->upgrade &&
-//                parser_->status != detail::s_message_done)
-//                return false;
+        /**
+         * @brief Parse @a len bytes of @a data.
+         *
+         * Parsing stops at the end of the current message.
+         * @return The number of bytes consumed, remaining bytes belong to the next (pipelined) message.
+         */
+        size_t parse(const char *data, size_t len) {
+            body_.clear();
+            return backend_.execute(*this, data, len);
         }
 
-        const void parse(std::string_view input) {
-            parse(input.data(), input.size());
+        size_t parse(std::string_view input) {
+            return parse(input.data(), input.size());
         }
 
         auto method() const {
-            return static_cast<http::method>(parser_->method);
+            return backend_.method();
         }
         auto status_code() const {
-            return static_cast<http::status>(parser_->status_code);
+            return backend_.status_code();
         }
 
+        /**
+         * @brief Load start line and headers into @a message (once).
+         */
         template <typename MessageT>
-        task<> load(MessageT &message) {
+        void load_head(MessageT &message) {
             static_assert(is_request == MessageT::is_request);
-            if constexpr (is_request) {
-                message.method = method();
-                message.path = url_;
-            } else {
-                message.status = status_code();
+            if (not headers_loaded_ and headers_complete_) {
+                if constexpr (is_request) {
+                    message.method = method();
+                    message.path = url_;
+                } else {
+                    message.status = status_code();
+                }
+                if (message.headers.empty()) {
+                    // swapped, so both sides keep their storage for the next message
+                    std::swap(message.headers, headers_);
+                } else {
+                    for (auto [field, value] : headers_) {
+                        message.headers.set(field, value);
+                    }
+                }
+                headers_.clear();
+                headers_loaded_ = true;
             }
-            if (!this->body_.empty()) {
-                co_await message.write_body(body_);
+        }
+
+        /**
+         * @brief Load parsed data into @a message.
+         *
+         * Start line and headers are loaded once, then each call hands the body fragments
+         * received by the last parse call over to the message.
+         * Fragments point to the parsed input buffer: load must be called before it is overwritten.
+         */
+        template <typename MessageT>
+        task<> load(MessageT &message) {
+            load_head(message);
+            for (auto &fragment : body_) {
+                if (not message.append_body(fragment)) {
+                    co_await message.write_body(fragment);
+                }
             }
+            body_.clear();
+        }
+
+        /**
+         * @brief Body fragments received by the last parse call.
+         */
+        const auto &body() const {
+            return body_;
         }
 
         const auto &url() const {
             return url_;
         }
 
+        const auto &headers() const {
+            return headers_;
+        }
+
         std::string to_string() const {
             fmt::memory_buffer out;
-            std::string_view type;
             if constexpr (is_request) {
                 fmt::format_to(out, "request {} {}",
-                               detail::http_method_str(detail::http_method(parser_->method)),
+                               detail::http_method_str(detail::http_method(method())),
                                url_);
             } else {
                 fmt::format_to(out, "response {} ",
-                               detail::http_status_str(detail::http_status(parser_->status_code)));
+                               detail::http_status_str(detail::http_status(status_code())));
             }
-            fmt::format_to(out, "{}", body_);
-            return out.data();
+            fmt::format_to(out, "{}", fmt::join(body_, ""));
+            return fmt::to_string(out);
         }
 
     protected:
@@ -142,116 +225,58 @@ namespace cppcoro::http::detail {
             on_message_begin,
             on_url,
             on_status,
-            on_headers,
+            on_header_field,
+            on_header_value,
             on_headers_complete,
             on_body,
             on_message_complete,
-            on_chunk_header,
-            on_chunk_header_compete,
         };
 
-        inline static auto &instance(detail::http_parser *parser) {
-            return *static_cast<self_type *>(parser->data);
+        void on_message_begin() {
+            state_ = status::on_message_begin;
         }
 
-        static inline int on_message_begin(detail::http_parser *parser)  {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_message_begin;
-            return 0;
+        void on_url(std::string_view data) {
+            url_.append(data);
+            state_ = status::on_url;
         }
 
-        static inline int on_url(detail::http_parser *parser, const char *data, size_t len) {
-            auto &this_ = instance(parser);
-            this_.url_ = {data, data + len};
-            this_.state_ = status::on_url;
-            return 0;
+        void on_status(std::string_view) {
+            state_ = status::on_status;
         }
 
-        static inline int on_status(detail::http_parser *parser, const char *data, size_t len) {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_status;
-            return 0;
+        // field and value may be split across several callbacks (ie.: segment boundaries)
+        void on_header_field(std::string_view data) {
+            headers_.append_field(data, state_ != status::on_header_field);
+            state_ = status::on_header_field;
         }
 
-        static inline int on_header_field(detail::http_parser *parser, const char *data, size_t len) {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_headers;
-            this_.header_field_ = {data, len};
-            return 0;
-        }
-
-        static inline int on_header_value(detail::http_parser *parser, const char *data, size_t len) {
-            auto &this_ = instance(parser);
-
-            this_.state_ = status::on_headers;
-            this_.headers_[std::string{this_.header_field_}] = {data, data + len};
-            return 0;
+        void on_header_value(std::string_view data) {
+            headers_.append_value(data);
+            state_ = status::on_header_value;
         }
 
-        static inline int on_headers_complete(detail::http_parser *parser) {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_headers_complete;
-            return 0;
+        void on_headers_complete() {
+            headers_complete_ = true;
+            state_ = status::on_headers_complete;
         }
 
-        static inline int on_body(detail::http_parser *parser, const char *data, size_t len) {
-            auto &this_ = instance(parser);
-            this_.body_ = {data, len};
-            this_.state_ = status::on_body;
-            return 0;
+        void on_body(std::string_view data) {
+            body_.emplace_back(data);
+            state_ = status::on_body;
         }
 
-        static inline int on_message_complete(detail::http_parser *parser) {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_message_complete;
-            return 0;
-        }
-
-        static inline int on_chunk_header(detail::http_parser *parser) {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_chunk_header;
-            return 0;
-        }
-
-        static inline int on_chunk_complete(detail::http_parser *parser) {
-            auto &this_ = instance(parser);
-            this_.state_ = status::on_chunk_header_compete;
-            return 0;
-        }
-
-        void init_parser() {
-            if (!parser_) {
-                parser_ = std::make_unique<detail::http_parser>();
-                if constexpr (is_request)
-                    http_parser_init(parser_.get(), detail::http_parser_type::HTTP_REQUEST);
-                else http_parser_init(parser_.get(), detail::http_parser_type::HTTP_RESPONSE);
-                parser_->data = this;
-            }
-        }
-
-        auto execute_parser(const char *data, size_t len) {
-            init_parser();
-            return http_parser_execute(parser_.get(), &http_parser_settings_, data, len);
+        void on_message_complete() {
+            state_ = status::on_message_complete;
         }
 
     private:
-        std::unique_ptr <detail::http_parser> parser_;
-        inline static detail::http_parser_settings http_parser_settings_ = {
-            on_message_begin,
-            on_url,
-            on_status,
-            on_header_field,
-            on_header_value,
-            on_headers_complete,
-            on_body,
-            on_message_complete,
-            on_chunk_header,
-            on_chunk_complete,
-        };
+        BackendT backend_;
         status state_{status::none};
-        std::string_view header_field_;
+        bool headers_complete_ = false;
+        bool headers_loaded_ = false;
         std::string url_;
-        std::string_view body_;
+        std::vector<std::string_view> body_;
         http::headers headers_;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,528 @@
+/**
+ * @file cppcoro/http/dynamic_router.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/http_request.hpp>
+#include <cppcoro/http/http_response.hpp>
+#include <cppcoro/http/route_parameter.hpp>
+#include <cppcoro/http/request_processor.hpp>
+#include <cppcoro/http/metrics.hpp>
+#include <cppcoro/task.hpp>
+
+#include <ctre.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cppcoro::http {
+
+    /**
+     * @brief Runtime router.
+     *
+     * Routes are registered (and removed) while serving. They are stored in a radix tree over path segments:
+     * consecutive literal segments share a single edge, "{}" segments are typed captures checked with
+     * route_parameter<T>::pattern and converted with route_parameter<T>::load.
+     * A std::filesystem::path capture, as the last segment, takes the remainder of the path.
+     *
+     * The tree is never modified in place: writers copy the nodes along the modified path (under a mutex),
+     * atomically publish the new root and bump a version number. Readers (see reader) only compare that version
+     * on the hot path and keep using their own snapshot: lookups take no lock and touch no shared cache line.
+     */
+    class dynamic_router
+    {
+    public:
+        using captures_type = std::span<const std::string_view>;
+        using handler_type = std::function<task<string_response>(string_request &, captures_type)>;
+
+    private:
+        using validator_type = bool (*)(std::string_view);
+
+        struct node;
+        using node_ptr = std::shared_ptr<const node>;
+
+        struct literal_edge
+        {
+            std::string label; // one or more segments, '/' separated
+            node_ptr child;
+        };
+
+        struct capture_edge
+        {
+            validator_type validate;
+            bool tail;
+            node_ptr child;
+        };
+
+        struct handler_entry
+        {
+            http::method method;
+            handler_type handler;
+            size_t route_id; // metrics label: the registered pattern
+        };
+
+        struct node
+        {
+            std::vector<literal_edge> literals; // sorted by first segment
+            std::vector<capture_edge> captures; // registration order
+            std::vector<handler_entry> handlers;
+        };
+
+        struct segment_spec
+        {
+            std::string_view literal;
+            validator_type validate = nullptr;
+            bool tail = false;
+
+            [[nodiscard]] bool is_capture() const noexcept {
+                return validate != nullptr;
+            }
+        };
+
+    public:
+        enum class lookup_status
+        {
+            found,
+            not_found,
+            method_not_allowed,
+        };
+
+        struct lookup_result
+        {
+            lookup_status status = lookup_status::not_found;
+            const handler_type *handler = nullptr;
+            size_t route_id = 0; ///< metrics index of the route, when found
+        };
+
+        /**
+         * @brief Lock-free view of the routes, not thread-safe (ie.: one per server connection).
+         *
+         * Each snapshot owns the tree it was taken from: a replaced tree is released with the last request
+         * running on it. Snapshots share a reference count private to the reader, not the router's.
+         */
+        class reader
+        {
+        public:
+            explicit reader(const dynamic_router &router) noexcept
+                : router_{router} {}
+
+            reader(const reader &) = delete;
+            reader &operator=(const reader &) = delete;
+
+            /**
+             * @brief Routes snapshot, valid while the handle lives (ie.: for a whole request).
+             */
+            class snapshot
+            {
+            public:
+                /**
+                 * @brief Find the handler of @a method on @a path, @a captures receives the captured segments.
+                 */
+                lookup_result find(http::method method, std::string_view path,
+                                   std::vector<std::string_view> &captures) const {
+                    captures.clear();
+                    if (auto query = path.find('?'); query != std::string_view::npos) {
+                        path = path.substr(0, query);
+                    }
+                    while (path.starts_with('/')) {
+                        path.remove_prefix(1);
+                    }
+                    const auto *found = root_ ? find_node(*root_, path, captures) : nullptr;
+                    if (not found) {
+                        return {};
+                    }
+                    for (auto &entry : found->handlers) {
+                        if (entry.method == method) {
+                            return {lookup_status::found, &entry.handler, entry.route_id};
+                        }
+                    }
+                    return {lookup_status::method_not_allowed};
+                }
+
+            private:
+                friend class reader;
+
+                explicit snapshot(node_ptr root) noexcept
+                    : root_{std::move(root)} {}
+
+                node_ptr root_;
+            };
+
+            [[nodiscard]] snapshot acquire() {
+                if (auto version = router_.version_.load(std::memory_order_acquire); version != version_) {
+                    // the root is at least as recent as the version: a newer one is picked up on the next call
+                    root_ = std::make_shared<const node_ptr>(router_.load_root());
+                    version_ = version;
+                }
+                // aliasing: the snapshot keeps the tree alive through the reader's own control block
+                return snapshot{node_ptr{root_, root_->get()}};
+            }
+
+        private:
+            const dynamic_router &router_;
+            uint64_t version_ = 0;
+            std::shared_ptr<const node_ptr> root_;
+        };
+
+        dynamic_router() = default;
+        dynamic_router(const dynamic_router &) = delete;
+        dynamic_router &operator=(const dynamic_router &) = delete;
+
+        /**
+         * @brief Register @a handler for @a method on @a pattern.
+         *
+         * Each "{}" segment of @a pattern captures a @a ParamsT, in order:
+         * @code
+         * router.add<int>(http::method::get, "/tenants/{}/status",
+         *                 [](http::string_request &request, int tenant) -> task<http::string_response> {...});
+         * @endcode
+         * An existing handler for the same method and pattern is replaced.
+         * Handlers are shared by every io thread: they are called as const, possibly concurrently.
+         */
+        template<typename...ParamsT, typename HandlerT>
+        void add(http::method method, std::string_view pattern, HandlerT &&handler) {
+            auto segments = parse<ParamsT...>(pattern);
+            handler_entry entry{method, {}, metrics::global().route(pattern)};
+            entry.handler = [handler = std::forward<HandlerT>(handler)]
+                (string_request &request, captures_type captures) {
+                return [&]<size_t...indexes>(std::index_sequence<indexes...>) {
+                    return handler(request, route_parameter<ParamsT>::load(captures[indexes])...);
+                }(std::index_sequence_for<ParamsT...>{});
+            };
+            std::scoped_lock lock{mutex_};
+            publish(insert(load_root().get(), segments, entry));
+        }
+
+        /**
+         * @brief Remove the handler of @a method on @a pattern.
+         * @return false when there was none.
+         */
+        template<typename...ParamsT>
+        bool remove(http::method method, std::string_view pattern) {
+            auto segments = parse<ParamsT...>(pattern);
+            std::scoped_lock lock{mutex_};
+            auto current = load_root();
+            if (not current) {
+                return false;
+            }
+            bool removed = false;
+            auto root = erase(*current, segments, method, removed);
+            if (removed) {
+                publish(is_empty(*root) ? nullptr : std::move(root));
+            }
+            return removed;
+        }
+
+    private:
+        template<typename T>
+        static bool validate_parameter(std::string_view segment) {
+            return bool(ctre::match<route_parameter<T>::pattern>(segment));
+        }
+
+        static std::string_view first_segment(std::string_view path) noexcept {
+            return path.substr(0, path.find('/'));
+        }
+
+        template<typename...ParamsT>
+        static std::vector<segment_spec> parse(std::string_view pattern) {
+            constexpr validator_type validators[] = {&validate_parameter<ParamsT>..., nullptr};
+            constexpr bool tails[] = {std::is_same_v<ParamsT, std::filesystem::path>..., false};
+            std::vector<segment_spec> segments;
+            size_t capture_count = 0;
+            while (pattern.starts_with('/')) {
+                pattern.remove_prefix(1);
+            }
+            while (not pattern.empty()) {
+                auto segment = first_segment(pattern);
+                pattern.remove_prefix(std::min(segment.size() + 1, pattern.size()));
+                if (segment.empty()) {
+                    continue;
+                }
+                if (segment == "{}") {
+                    if (capture_count == sizeof...(ParamsT)) {
+                        throw std::invalid_argument{"more captures than parameters in route pattern"};
+                    }
+                    if (tails[capture_count] and not pattern.empty()) {
+                        throw std::invalid_argument{"path captures must be the last route segment"};
+                    }
+                    segments.push_back({{}, validators[capture_count], tails[capture_count]});
+                    ++capture_count;
+                } else {
+                    segments.push_back({segment});
+                }
+            }
+            if (capture_count != sizeof...(ParamsT)) {
+                throw std::invalid_argument{"less captures than parameters in route pattern"};
+            }
+            return segments;
+        }
+
+        static bool is_empty(const node &current) noexcept {
+            return current.handlers.empty() and current.literals.empty() and current.captures.empty();
+        }
+
+        static const node *find_node(const node &current, std::string_view path,
+                                     std::vector<std::string_view> &captures) {
+            if (path.empty()) {
+                return current.handlers.empty() ? nullptr : &current;
+            }
+            const auto segment = first_segment(path);
+            const auto rest = path.substr(std::min(segment.size() + 1, path.size()));
+            // literals first
+            auto literal = std::lower_bound(current.literals.begin(), current.literals.end(), segment,
+                                            [](const literal_edge &edge, std::string_view value) {
+                                                return first_segment(edge.label) < value;
+                                            });
+            if (literal != current.literals.end() and path.starts_with(literal->label)
+                and (path.size() == literal->label.size() or path[literal->label.size()] == '/')) {
+                auto remaining = path.substr(std::min(literal->label.size() + 1, path.size()));
+                if (auto *found = find_node(*literal->child, remaining, captures)) {
+                    return found;
+                }
+            }
+            for (auto &capture : current.captures) {
+                const auto value = capture.tail ? path : segment;
+                if (capture.validate(value)) {
+                    captures.push_back(value);
+                    if (auto *found = find_node(*capture.child, capture.tail ? std::string_view{} : rest, captures)) {
+                        return found;
+                    }
+                    captures.pop_back();
+                }
+            }
+            return nullptr;
+        }
+
+        static node_ptr insert(const node *current, std::span<const segment_spec> segments, handler_entry &entry) {
+            auto result = current ? std::make_shared<node>(*current) : std::make_shared<node>();
+            if (segments.empty()) {
+                auto it = std::find_if(result->handlers.begin(), result->handlers.end(), [&entry](auto &elem) {
+                    return elem.method == entry.method;
+                });
+                if (it != result->handlers.end()) {
+                    *it = std::move(entry);
+                } else {
+                    result->handlers.push_back(std::move(entry));
+                }
+                return result;
+            }
+            if (segments.front().is_capture()) {
+                auto &spec = segments.front();
+                auto it = std::find_if(result->captures.begin(), result->captures.end(), [&spec](auto &edge) {
+                    return edge.validate == spec.validate and edge.tail == spec.tail;
+                });
+                if (it != result->captures.end()) {
+                    it->child = insert(it->child.get(), segments.subspan(1), entry);
+                } else {
+                    result->captures.push_back({spec.validate, spec.tail,
+                                                insert(nullptr, segments.subspan(1), entry)});
+                }
+                return result;
+            }
+            const auto literal_count = size_t(std::find_if(segments.begin(), segments.end(), [](auto &spec) {
+                return spec.is_capture();
+            }) - segments.begin());
+            auto it = std::lower_bound(result->literals.begin(), result->literals.end(), segments.front().literal,
+                                       [](const literal_edge &edge, std::string_view value) {
+                                           return first_segment(edge.label) < value;
+                                       });
+            if (it == result->literals.end() or first_segment(it->label) != segments.front().literal) {
+                std::string label;
+                for (auto &spec : segments.first(literal_count)) {
+                    if (not label.empty()) {
+                        label += '/';
+                    }
+                    label.append(spec.literal);
+                }
+                result->literals.insert(it, {std::move(label),
+                                             insert(nullptr, segments.subspan(literal_count), entry)});
+                return result;
+            }
+            // count the segments shared with the edge label
+            std::string_view label = it->label;
+            size_t common = 0;
+            size_t common_size = 0;
+            while (common < literal_count) {
+                auto segment = first_segment(label.substr(common_size));
+                if (segment != segments[common].literal) {
+                    break;
+                }
+                common_size += segment.size();
+                ++common;
+                if (common_size == label.size()) {
+                    break;
+                }
+                ++common_size; // separator
+            }
+            if (common_size == label.size()) {
+                it->child = insert(it->child.get(), segments.subspan(common), entry);
+            } else {
+                // split the edge
+                auto middle = std::make_shared<node>();
+                middle->literals.push_back({std::string{label.substr(common_size)}, std::move(it->child)});
+                it->child = insert(middle.get(), segments.subspan(common), entry);
+                it->label.resize(common_size - 1);
+            }
+            return result;
+        }
+
+        /**
+         * @brief Copy of @a current without the handler, nodes left empty are pruned.
+         *
+         * A literal edge leading to a node left with a single literal edge and nothing else is merged with it:
+         * the split made when the removed route was inserted is undone.
+         */
+        static node_ptr erase(const node &current, std::span<const segment_spec> segments,
+                              http::method method, bool &removed) {
+            if (segments.empty()) {
+                auto it = std::find_if(current.handlers.begin(), current.handlers.end(), [method](auto &elem) {
+                    return elem.method == method;
+                });
+                if (it == current.handlers.end()) {
+                    return nullptr;
+                }
+                auto result = std::make_shared<node>(current);
+                result->handlers.erase(result->handlers.begin() + (it - current.handlers.begin()));
+                removed = true;
+                return result;
+            }
+            if (segments.front().is_capture()) {
+                auto &spec = segments.front();
+                for (size_t ii = 0; ii < current.captures.size(); ++ii) {
+                    auto &edge = current.captures[ii];
+                    if (edge.validate == spec.validate and edge.tail == spec.tail) {
+                        auto child = erase(*edge.child, segments.subspan(1), method, removed);
+                        if (not removed) {
+                            return nullptr;
+                        }
+                        auto result = std::make_shared<node>(current);
+                        if (is_empty(*child)) {
+                            result->captures.erase(result->captures.begin() + ii);
+                        } else {
+                            result->captures[ii].child = std::move(child);
+                        }
+                        return result;
+                    }
+                }
+                return nullptr;
+            }
+            for (size_t ii = 0; ii < current.literals.size(); ++ii) {
+                std::string_view label = current.literals[ii].label;
+                size_t count = 0;
+                while (count < segments.size() and not segments[count].is_capture()) {
+                    auto segment = first_segment(label);
+                    if (segment != segments[count].literal) {
+                        break;
+                    }
+                    ++count;
+                    label.remove_prefix(std::min(segment.size() + 1, label.size()));
+                    if (label.empty()) {
+                        break;
+                    }
+                }
+                if (count and label.empty()) {
+                    auto child = erase(*current.literals[ii].child, segments.subspan(count), method, removed);
+                    if (not removed) {
+                        return nullptr;
+                    }
+                    auto result = std::make_shared<node>(current);
+                    auto &edge = result->literals[ii];
+                    if (is_empty(*child)) {
+                        result->literals.erase(result->literals.begin() + ii);
+                    } else if (child->handlers.empty() and child->captures.empty() and child->literals.size() == 1) {
+                        auto &next = child->literals.front();
+                        edge.label += '/';
+                        edge.label += next.label;
+                        edge.child = next.child;
+                    } else {
+                        edge.child = std::move(child);
+                    }
+                    return result;
+                }
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] node_ptr load_root() const {
+            return std::atomic_load_explicit(&root_, std::memory_order_acquire);
+        }
+
+        void publish(node_ptr root) {
+            std::atomic_store_explicit(&root_, std::move(root), std::memory_order_release);
+            version_.fetch_add(1, std::memory_order_release);
+        }
+
+        std::mutex mutex_; // writers
+        node_ptr root_; // accessed atomically
+        std::atomic<uint64_t> version_ = 1;
+    };
+
+    namespace detail {
+        struct dynamic_session
+        {
+            string_request request{http::method::unknown, ""};
+            std::vector<std::string_view> captures;
+            std::optional<dynamic_router::reader> routes; // per connection: readers are not thread-safe
+        };
+    }
+
+    /**
+     * @brief Server dispatching requests through a dynamic_router.
+     *
+     * Routes can be added or removed while serving, from any thread.
+     * Each connection reads the routes through its own reader: connections may run on any io thread.
+     */
+    class dynamic_server : public request_processor<detail::dynamic_session, dynamic_server>
+    {
+        using processor_type = request_processor<detail::dynamic_session, dynamic_server>;
+
+    public:
+        dynamic_server(io_service &service, const net::ip_endpoint &endpoint, bool reuse_port, dynamic_router &router)
+            : processor_type{service, endpoint, reuse_port}, router_{router} {}
+
+        dynamic_server(io_service &service, const net::ip_endpoint &endpoint, dynamic_router &router)
+            : dynamic_server{service, endpoint, false, router} {}
+
+        http::detail::base_request *prepare(const http::request_parser &, session_type &session) {
+            session.request.clear();
+            return &session.request;
+        }
+
+        tcp::connection_task<> process(http::detail::base_request &, server::connection_type &connection, session_type &session) {
+            if (not session.routes) {
+                session.routes.emplace(router_);
+            }
+            // the snapshot keeps the matched handler alive until the response is sent
+            auto routes = session.routes->acquire();
+            auto &request = session.request;
+            auto route = routes.find(request.method, request.path, session.captures);
+            metrics::local().route(route.status == dynamic_router::lookup_status::found ? route.route_id
+                                                                                        : unmatched_route_id_);
+            if (route.status == dynamic_router::lookup_status::found) {
+                auto response = co_await (*route.handler)(request, session.captures);
+                co_await connection.send(response);
+            } else {
+                string_response response{route.status == dynamic_router::lookup_status::not_found
+                                         ? http::status::HTTP_STATUS_NOT_FOUND
+                                         : http::status::HTTP_STATUS_METHOD_NOT_ALLOWED};
+                co_await connection.send(response);
+            }
+        }
+
+    private:
+        dynamic_router &router_;
+        const size_t unmatched_route_id_ = metrics::global().route(metrics::unmatched_route);
+    };
+}
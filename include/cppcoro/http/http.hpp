@@ -3,12 +3,32 @@
  */
 #pragma once
 
-#include <map>
+#include <cppcoro/http/http_headers.hpp>
+
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+/**
+ * Connection logs below this spdlog level (SPDLOG_LEVEL_*) are compiled out.
+ * Defaults to info in release builds: debug and trace cost nothing on the hot paths.
+ */
+#ifndef CPPCORO_HTTP_LOG_ACTIVE_LEVEL
+#ifdef NDEBUG
+#define CPPCORO_HTTP_LOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#else
+#define CPPCORO_HTTP_LOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+#endif
+#endif
+
 namespace cppcoro::http {
 
     namespace detail {
@@ -28,37 +48,198 @@ namespace cppcoro::http {
     };
 
     using status = detail::http_status;
-    using headers = std::map<std::string, std::string>;
 
     namespace logging {
-        static inline spdlog::level_t log_level = spdlog::level::warn;
+        inline spdlog::level_t log_level = spdlog::level::warn;
         constexpr auto logger_name = "cppcoro::http";
-        inline static auto logger = [] () -> std::shared_ptr<spdlog::logger> {
-            if (auto logger = spdlog::get(logger_name);
-                logger) {
-                return logger;
+
+        /**
+         * @brief Levels below this one are compiled out of connection logs.
+         */
+        static constexpr auto active_level = spdlog::level::level_enum(CPPCORO_HTTP_LOG_ACTIVE_LEVEL);
+
+        namespace detail {
+            /**
+             * @brief The logger shared by every translation unit.
+             *
+             * A replaced logger is retired, not destroyed: log calls of other threads may still be using it.
+             * Retired loggers are released by the next replacement made while no log call is in flight.
+             */
+            struct shared_logger
+            {
+                struct entry
+                {
+                    std::shared_ptr<spdlog::details::thread_pool> pool; // async loggers only
+                    std::shared_ptr<spdlog::logger> logger;
+                };
+
+                std::mutex mutex; // replacements
+                entry owner;
+                std::vector<entry> retired;
+                std::atomic<spdlog::logger *> current;
+                std::atomic<size_t> readers = 0; // log calls in flight
+
+                void replace(entry next) {
+                    current.store(next.logger.get(), std::memory_order_seq_cst);
+                    if (owner.logger) {
+                        retired.push_back(std::move(owner));
+                    }
+                    owner = std::move(next);
+                    // a log call starting from now on gets the new logger
+                    if (readers.load(std::memory_order_seq_cst) == 0) {
+                        retired.clear();
+                    }
+                }
+            };
+
+            inline shared_logger &logger_state() {
+                // never destroyed: connections may log while static objects are destroyed
+                static auto *state = [] {
+                    auto *state = new shared_logger;
+                    auto logger = spdlog::get(logger_name);
+                    if (not logger) {
+                        logger = spdlog::stdout_color_mt(logger_name);
+                        logger->set_level(spdlog::level::trace); // filtered by log_level
+                    }
+                    state->replace({nullptr, std::move(logger)});
+                    return state;
+                }();
+                return *state;
             }
-            return spdlog::stdout_color_mt(logger_name);
-        }();
-        template <typename IdT>
-        auto logger_id(IdT &&id) {
-            return fmt::format("{}::{}", logger_name, std::forward<IdT>(id));
+
+            /**
+             * @brief Use of the shared logger for one log call: keeps it from being released.
+             */
+            class logger_lease
+            {
+            public:
+                logger_lease() noexcept
+                    : state_{logger_state()} {
+                    state_.readers.fetch_add(1, std::memory_order_seq_cst);
+                    logger_ = state_.current.load(std::memory_order_seq_cst);
+                }
+
+                logger_lease(const logger_lease &) = delete;
+                logger_lease &operator=(const logger_lease &) = delete;
+
+                ~logger_lease() {
+                    state_.readers.fetch_sub(1, std::memory_order_release);
+                }
+
+                spdlog::logger *operator->() const noexcept {
+                    return logger_;
+                }
+
+            private:
+                shared_logger &state_;
+                spdlog::logger *logger_;
+            };
         }
-        template <typename IdT>
-        auto get_logger(IdT &&id) {
-            const auto _id = logger_id(std::forward<IdT>(id));
-            if (auto _logger = spdlog::get(_id);
-                _logger) {
-                return _logger;
-            }
-            auto &sinks = logging::logger->sinks();
-            auto this_logger = std::make_shared<spdlog::logger>(_id, begin(sinks), end(sinks));
-            this_logger->set_level(spdlog::level::level_enum(log_level.load(std::memory_order_relaxed)));
-            return this_logger;
+
+        /**
+         * @brief The shared cppcoro::http logger.
+         *
+         * The reference is valid until the next use_async() call.
+         */
+        inline spdlog::logger &logger() {
+            return *detail::logger_state().current.load(std::memory_order_acquire);
         }
-        template <typename IdT>
-        auto drop_logger(IdT &&id) {
-            spdlog::drop(logger_id(std::forward<IdT>(id)));
+
+        /**
+         * @brief Log through background threads from now on.
+         *
+         * Connection logs only enqueue their messages, the sinks are written by @a thread_count threads.
+         * Can be called while serving, from any thread: connections switch to the new logger on their next line.
+         * Calling it again rebuilds the async logger with the new settings, over the same sinks.
+         */
+        inline void use_async(size_t queue_size = 8192, size_t thread_count = 1) {
+            auto &state = detail::logger_state();
+            std::scoped_lock lock{state.mutex};
+            // a pool of our own: replacing spdlog's global one would break the async loggers still in use
+            auto pool = std::make_shared<spdlog::details::thread_pool>(queue_size, thread_count);
+            auto &sinks = state.owner.logger->sinks();
+            auto async_logger = std::make_shared<spdlog::async_logger>(
+                logger_name, begin(sinks), end(sinks), pool, spdlog::async_overflow_policy::overrun_oldest);
+            async_logger->set_level(spdlog::level::trace);
+            spdlog::drop(logger_name);
+            spdlog::register_logger(async_logger);
+            state.replace({std::move(pool), std::move(async_logger)});
         }
+
+        /**
+         * @brief Connection logging context.
+         *
+         * Lines go to the shared logger, prefixed with the connection id: creating one costs
+         * no allocation, no name formatting and no registry lock.
+         */
+        class connection_logger
+        {
+        public:
+            connection_logger() noexcept
+                : id_{next_id_.fetch_add(1, std::memory_order_relaxed)} {}
+
+            connection_logger(connection_logger &&other) noexcept
+                : id_{std::exchange(other.id_, 0)} {}
+
+            connection_logger(const connection_logger &) = delete;
+            connection_logger &operator=(const connection_logger &) = delete;
+            connection_logger &operator=(connection_logger &&) = delete;
+
+            /**
+             * @brief Connection id, 0 once moved from.
+             */
+            [[nodiscard]] uint64_t id() const noexcept {
+                return id_;
+            }
+
+            template<spdlog::level::level_enum level, typename...ArgsT>
+            void log(fmt::string_view format, const ArgsT &...args) const {
+                if constexpr (level >= active_level) {
+                    if (level < log_level.load(std::memory_order_relaxed)) {
+                        return;
+                    }
+                    fmt::memory_buffer buffer;
+#if FMT_VERSION < 80000
+                    // fmt 7 (the pinned version) formats into memory buffers directly
+                    fmt::format_to(buffer, "[connection {}] ", id_);
+                    fmt::vformat_to(buffer, format, fmt::make_format_args(args...));
+#else
+                    fmt::format_to(std::back_inserter(buffer), "[connection {}] ", id_);
+                    fmt::vformat_to(std::back_inserter(buffer), format, fmt::make_format_args(args...));
+#endif
+                    detail::logger_lease logger;
+                    logger->log(level, spdlog::string_view_t{buffer.data(), buffer.size()});
+                }
+            }
+
+            template<typename...ArgsT>
+            void trace(fmt::string_view format, const ArgsT &...args) const {
+                log<spdlog::level::trace>(format, args...);
+            }
+
+            template<typename...ArgsT>
+            void debug(fmt::string_view format, const ArgsT &...args) const {
+                log<spdlog::level::debug>(format, args...);
+            }
+
+            template<typename...ArgsT>
+            void info(fmt::string_view format, const ArgsT &...args) const {
+                log<spdlog::level::info>(format, args...);
+            }
+
+            template<typename...ArgsT>
+            void warn(fmt::string_view format, const ArgsT &...args) const {
+                log<spdlog::level::warn>(format, args...);
+            }
+
+            template<typename...ArgsT>
+            void error(fmt::string_view format, const ArgsT &...args) const {
+                log<spdlog::level::err>(format, args...);
+            }
+
+        private:
+            static inline std::atomic<uint64_t> next_id_ = 1;
+            uint64_t id_;
+        };
     }
 }
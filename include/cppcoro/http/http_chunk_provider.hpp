@@ -47,6 +47,10 @@ namespace cppcoro::http {
         read_only_file_chunk_provider(io_service &service, std::string_view path) noexcept:
             abstract_chunk_base{service}, path_{path} {}
 
+        [[nodiscard]] std::string_view path() const noexcept {
+            return path_;
+        }
+
         async_generator<std::string_view> read(size_t chunk_size) {
             if (!path_.empty()) {
                 auto f = read_only_file::open(service(), path_);
@@ -67,6 +71,7 @@ namespace cppcoro::http {
 
     static_assert(std::constructible_from<read_only_file_chunk_provider, io_service &>);
     static_assert(http::detail::ro_chunked_body<read_only_file_chunk_provider>);
+    static_assert(http::detail::ro_file_body<read_only_file_chunk_provider>);
 
     using read_only_file_chunked_response = http::abstract_response<read_only_file_chunk_provider>;
     using read_only_file_chunked_request = http::abstract_request<read_only_file_chunk_provider>;
@@ -4,16 +4,29 @@
 #include <cppcoro/http/http.hpp>
 #include <cppcoro/http/http_request.hpp>
 #include <cppcoro/http/http_response.hpp>
+#include <cppcoro/http/metrics.hpp>
 #include <cppcoro/task.hpp>
 #include <cppcoro/when_all.hpp>
+#include <cppcoro/async_mutex.hpp>
+#include <cppcoro/sequence_barrier.hpp>
+#include <cppcoro/on_scope_exit.hpp>
 
 #include <cppcoro/fmt/stringable.hpp>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <charconv>
+#include <chrono>
 #include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 namespace cppcoro::http {
 
@@ -24,14 +37,10 @@ namespace cppcoro::http {
     template<typename ParentT, typename ResponseT = string_response, typename RequestT = string_request>
     class connection : public tcp::connection
     {
-        std::shared_ptr<spdlog::logger> logger_ = [this]() mutable {
-            auto logger = logging::get_logger(*this);
-            logger->flush_on(spdlog::level::debug);
-            return logger;
-        }();
+        logging::connection_logger logger_;
     public:
         auto &logger() {
-            return *logger_;
+            return logger_;
         }
 
         std::string to_string() const {
@@ -57,13 +66,20 @@ namespace cppcoro::http {
         connection(connection &&other) noexcept
             : tcp::connection{std::move(other)}, parent_{other.parent_}, /*input_{std::move(other.input_)},*/
               buffer_{std::move(other.buffer_)},
+              input_begin_{other.input_begin_},
+              input_end_{other.input_end_},
+              pending_output_{std::move(other.pending_output_)},
+              header_{std::move(other.header_)},
+              parser_{std::move(other.parser_)},
+              received_at_{other.received_at_},
+              send_time_{other.send_time_},
+              pipeline_{std::move(other.pipeline_)},
               logger_{std::move(other.logger_)} {
         }
 
         virtual ~connection() noexcept {
-            if (logger_) {
-                logger_->info("connection closed");
-                logging::drop_logger(*this);
+            if (logger_.id()) {
+                logger_.info("connection closed");
             }
         }
 
@@ -76,59 +92,136 @@ namespace cppcoro::http {
         explicit connection(server &server, tcp::connection connection)
             : tcp::connection(std::move(connection)), parent_{server}, /*input_{std::make_unique<request>()},*/
               buffer_(2048, 0) {
-            logger_->info("new sever connection");
+            logger_.info("new server connection from {}", peer_address());
         }
 
         explicit connection(client &client, tcp::connection connection)
             : tcp::connection(std::move(connection)), parent_{client}, /*input_{std::make_unique<response>()},*/
-              buffer_(2048, 0) {
-            logger_->info("new client connection");
+              buffer_(2048, 0), pipeline_{std::make_unique<pipeline>()} {
+            logger_.info("new client connection to {}", peer_address());
         }
 
-        task<receive_type *> next(std::function<base_receive_type &(const parser_type &)> init) {
-            base_receive_type *result = nullptr;
-            parser_type parser;
+        /**
+         * @brief Receive the next message.
+         *
+         * @a init is called once the head is parsed and gives the message to load it into,
+         * its body is written as it comes in.
+         */
+        template<typename InitT,
+            typename MessageT = std::remove_reference_t<std::invoke_result_t<InitT &, const parser_type &>>>
+        requires std::derived_from<MessageT, base_receive_type>
+        tcp::connection_task<MessageT *> next(InitT &&init) {
+            MessageT *result = nullptr;
+            auto &parser = parser_;
+            parser.reset();
             auto init_result = [&] {
                 result = &init(parser);
                 if (!result) {
-                    logger_->warn("unable to get valid message handler for {}", parser);
+                    logger_.warn("unable to get valid message handler for {}", parser);
                 }
             };
+            bool started = false; // got bytes of this message
+            std::chrono::steady_clock::time_point head_deadline{}; // none when the header timeout is disabled
+            std::chrono::steady_clock::duration parse_time{};
             while (true) {
-                co_await parent_.service().schedule();
-                logger_->debug("waiting for incoming message...");
-                //std::fill(begin(buffer_), end(buffer_), '\0');
-                auto ret = co_await sock_.recv(buffer_.data(), buffer_.size(), ct_);
-                logger_->debug("got something: {}", ret);
-                bool done = ret <= 0;
-                if (!done) {
-                    parser.parse(buffer_.data(), ret);
-                    if (!result) init_result();
-                    if (parser.has_body() && not parser) {
-                        // chunk
-                        if (result) {
-                            co_await parser.load(*result);
-                            logger_->debug("chunked message: {}", *result);
-                        } else {
-                            co_return nullptr;
+                if (not has_pending_input()) {
+                    if (not pending_output_.empty()) {
+                        co_await flush(); // takes over the deadline
+                        if (started and not parser.headers_complete()) {
+                            expires_at(head_deadline); // flushing does not give the head more time
                         }
                     }
-                    if (parser) {
-                        if (!result) init_result();
-                        if (result) {
-                            co_await parser.load(*result);
-                            logger_->debug("message: {}", *result);
-                            co_return std::move(static_cast<receive_type *>(result));
-                        } else {
-                            co_return nullptr;
-                        }
+                    co_await parent_.service().schedule();
+                    logger_.debug("waiting for incoming message...");
+                    if (not started or parser.headers_complete()) {
+                        // idle between messages, or body progress
+                        expires_after(timeouts().idle);
+                    }
+                    auto ret = co_await sock_.recv(buffer_.data(), buffer_.size(), ct_);
+                    logger_.debug("got something: {}", ret);
+                    if (ret <= 0) {
+                        expires_after({});
+                        co_return nullptr;
+                    }
+                    if constexpr (is_server()) {
+                        metrics::local().bytes_in.add(size_t(ret));
+                    }
+                    input_begin_ = 0;
+                    input_end_ = size_t(ret);
+                }
+                if (not started) {
+                    // the whole head must come in time, however slowly it is sent
+                    started = true;
+                    if (timeouts().header.count()) {
+                        head_deadline = std::chrono::steady_clock::now() + timeouts().header;
+                    }
+                    expires_at(head_deadline);
+                }
+                const auto parse_start = std::chrono::steady_clock::now();
+                input_begin_ += parser.parse(buffer_.data() + input_begin_, input_end_ - input_begin_);
+                parse_time += std::chrono::steady_clock::now() - parse_start;
+                if (!result && parser.headers_complete()) init_result();
+                if (parser.has_body() && not parser) {
+                    // chunk
+                    if (result) {
+                        co_await load(*result);
+                        logger_.debug("chunked message: {}", *result);
+                    } else {
+                        co_await flush(); // responses of the previous pipelined messages
+                        co_return nullptr;
+                    }
+                }
+                if (parser) {
+                    expires_after({});
+                    received_at_ = std::chrono::steady_clock::now();
+                    if constexpr (is_server()) {
+                        metrics::local().parse_latency.record(parse_time);
+                    }
+                    if (!result) init_result();
+                    if (result) {
+                        co_await load(*result);
+                        logger_.debug("message: {}", *result);
+                        co_return result;
+                    } else {
+                        co_await flush(); // responses of the previous pipelined messages
+                        co_return nullptr;
                     }
-                } else {
-                    co_return nullptr;
                 }
             }
         }
 
+        /**
+         * @brief When the last message returned by next() was fully parsed.
+         */
+        [[nodiscard]] std::chrono::steady_clock::time_point received_at() const noexcept {
+            return received_at_;
+        }
+
+        /**
+         * @brief Time spent in send() so far.
+         */
+        [[nodiscard]] std::chrono::steady_clock::duration send_time() const noexcept {
+            return send_time_;
+        }
+
+        /**
+         * @brief Received bytes not parsed yet (ie.: pipelined requests).
+         */
+        [[nodiscard]] bool has_pending_input() const noexcept {
+            return input_begin_ < input_end_;
+        }
+
+        /**
+         * @brief Send queued responses, if any.
+         */
+        tcp::connection_task<> flush() {
+            if (pending_output_.empty()) {
+                co_return;
+            }
+            std::array buffers{iovec{pending_output_.data(), pending_output_.size()}};
+            count_sent(co_await send_vectored(buffers), pending_output_.size());
+            pending_output_.clear();
+        }
 
         auto post(std::string &&path, std::string &&data = "") requires(is_client()) {
             return _send<http::method::post>(std::forward<std::string>(path), std::forward<std::string>(data));
@@ -138,44 +231,153 @@ namespace cppcoro::http {
             return _send<http::method::get>(std::forward<std::string>(path), std::forward<std::string>(data));
         }
 
-        task<> send(std::derived_from<http::detail::base_message> auto &to_send) {
-            auto header = to_send.build_header();
+        /**
+         * @brief Post @a data to @a path, the response body is streamed into @a body.
+         */
+        template<http::detail::writeable_body BodyT>
+        auto post(std::string &&path, std::string &&data, BodyT body) requires(is_client()) {
+            return _send<http::method::post>(std::forward<std::string>(path), std::forward<std::string>(data),
+                                             std::move(body));
+        }
+
+        /**
+         * @brief Get @a path, the response body is streamed into @a body.
+         *
+         * ie.: downloading to a file through a write_only_file_processor, memory use does not depend
+         * on the response size.
+         */
+        template<http::detail::writeable_body BodyT>
+        auto get(std::string &&path, BodyT body) requires(is_client()) {
+            return _send<http::method::get>(std::forward<std::string>(path), {}, std::move(body));
+        }
+
+        /**
+         * @brief Send @a to_send.
+         *
+         * Basic bodies of concrete message types are read in place: no virtual call, no coroutine frame.
+         */
+        template<std::derived_from<http::detail::base_message> MessageT>
+        tcp::connection_task<> send(MessageT &to_send) {
+            http::status sent_status{}; // replaced by the error response's, when one is sent instead
+            if constexpr (is_server() and std::derived_from<MessageT, http::detail::base_response>) {
+                sent_status = to_send.status;
+            }
+            const auto send_start = std::chrono::steady_clock::now();
+            auto record_send = on_scope_exit([&] {
+                if constexpr (is_server()) {
+                    const auto elapsed = std::chrono::steady_clock::now() - send_start;
+                    send_time_ += elapsed;
+                    metrics::local().send_latency.record(elapsed);
+                    if constexpr (std::derived_from<MessageT, http::detail::base_response>) {
+                        metrics::local().status(int(sent_status));
+                    }
+                }
+            });
+            if (auto path = to_send.file_path(); not path.empty()) {
+                if (co_await send_file(to_send, path)) {
+                    co_return;
+                }
+            }
+            bool head_sent = false;
             try {
                 if (to_send.is_chunked()) {
-                    std::string_view body;
-                    auto size = co_await sock_.send(header.data(), header.size(), ct_);
-                    assert(size == header.size());
-                    body = co_await to_send.read_body();
+                    // chunk framing is merged with the payload so each chunk costs a single write:
+                    // the header goes out with the first chunk, each chunk's CRLF with the next one
+                    header_.clear();
+                    to_send.build_header(header_);
+                    // with a Content-Length the header carries no Transfer-Encoding: chunks are sent raw
+                    const std::string_view content_length = std::as_const(to_send.headers)["Content-Length"];
+                    const bool framed = content_length.empty();
+                    size_t body_size = 0;
+                    std::array<char, 24> framing;
+                    auto body = co_await to_send.read_body();
                     while (!body.empty()) {
-                        auto size_str = fmt::format("{:x}\r\n", body.size());
-                        co_await sock_.send(size_str.data(), size_str.size(), ct_);
-                        logger_->debug("chunked body: {}", body);
-                        size = co_await sock_.send(body.data(), body.size(), ct_);
-                        if(size != body.size()) {
-                            logger_->error("body not sent ({}/{})", size, body.size());
-                        } else {
-                            co_await sock_.send("\r\n", 2, ct_);
+                        auto *framing_end = framing.data();
+                        if (framed) {
+                            if (head_sent) {
+                                framing_end = std::copy_n("\r\n", 2, framing_end);
+                            }
+                            framing_end = std::to_chars(framing_end, framing.data() + framing.size(), body.size(), 16).ptr;
+                            framing_end = std::copy_n("\r\n", 2, framing_end);
                         }
+                        const auto framing_size = size_t(framing_end - framing.data());
+                        body_size += body.size();
+                        logger_.trace("chunk: {} bytes", body.size());
+                        std::array buffers{
+                            iovec{pending_output_.data(), pending_output_.size()},
+                            iovec{header_.data(), header_.size()},
+                            iovec{framing.data(), framing_size},
+                            iovec{const_cast<char *>(body.data()), body.size()},
+                        };
+                        count_sent(co_await send_vectored(buffers),
+                                   pending_output_.size() + header_.size() + framing_size + body.size());
+                        head_sent = true;
+                        pending_output_.clear();
+                        header_.clear();
                         body = co_await to_send.read_body();
                     }
-                    auto size_str = fmt::format("{}\r\n\r\n", 0);
-                    co_await sock_.send(size_str.data(), size_str.size(), ct_);
-
+                    std::string_view terminator;
+                    if (framed) {
+                        terminator = head_sent ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+                    }
+                    if (framed or not head_sent) {
+                        std::array buffers{
+                            iovec{pending_output_.data(), pending_output_.size()},
+                            iovec{header_.data(), header_.size()},
+                            iovec{const_cast<char *>(terminator.data()), terminator.size()},
+                        };
+                        count_sent(co_await send_vectored(buffers),
+                                   pending_output_.size() + header_.size() + terminator.size());
+                        head_sent = true;
+                        pending_output_.clear();
+                    }
+                    if (not framed) {
+                        size_t declared_size = 0;
+                        std::from_chars(content_length.data(), content_length.data() + content_length.size(),
+                                        declared_size);
+                        if (body_size != declared_size) {
+                            // the peer expects another length: the stream cannot be resynchronized
+                            logger_.error("body length mismatch ({}/{})", body_size, declared_size);
+                            throw std::system_error{std::make_error_code(std::errc::connection_aborted),
+                                                    "body length mismatch"};
+                        }
+                    }
                 } else {
-                    auto body = co_await to_send.read_body();
-                    auto size = co_await sock_.send(header.data(), header.size(), ct_);
-                    assert(size == header.size());
-                    if (!body.empty()) {
-                        logger_->debug("body: {}", body);
-                        auto size = co_await sock_.send(body.data(), body.size(), ct_);
-                        assert(size == body.size());
+                    std::string_view body;
+                    if constexpr (http::detail::typed_message<MessageT>
+                                  and http::detail::ro_basic_body<typename MessageT::body_type>) {
+                        body = {to_send.body_access.data(), to_send.body_access.size()};
+                    } else {
+                        body = co_await to_send.read_body();
                     }
+                    logger_.trace("body: {} bytes", body.size());
+                    if constexpr (is_server()) {
+                        if (has_pending_input() and pending_output_.size() < max_pending_output) {
+                            // pipelined requests are waiting: queue the response, it goes out with the next ones
+                            to_send.build_header(pending_output_);
+                            pending_output_.append(body);
+                            co_return;
+                        }
+                    }
+                    header_.clear();
+                    to_send.build_header(header_);
+                    std::array buffers{
+                        iovec{pending_output_.data(), pending_output_.size()},
+                        iovec{header_.data(), header_.size()},
+                        iovec{const_cast<char *>(body.data()), body.size()},
+                    };
+                    count_sent(co_await send_vectored(buffers), pending_output_.size() + header_.size() + body.size());
+                    pending_output_.clear();
                 }
             } catch (std::system_error &error) {
-                if (error.code() == std::errc::connection_reset) {
-                    throw error; // Connection reset by peer
+                if (tcp::connection_lost(error)) {
+                    throw; // part of the message may be out: nothing else can be sent
+                } else if (head_sent) {
+                    // the status line is out: the stream cannot carry an error response anymore
+                    logger_.error("body not sent: {}", error.what());
+                    throw std::system_error{std::make_error_code(std::errc::connection_aborted), error.what()};
                 }
-                logger_->error("system_error caught: {}", error.what());
+                logger_.error("system_error caught: {}", error.what());
                 if constexpr (is_server()) {
                     string_response error_message {
                         http::status::HTTP_STATUS_INTERNAL_SERVER_ERROR,
@@ -185,12 +387,18 @@ namespace cppcoro::http {
                     if (error.code() == std::errc::no_such_file_or_directory) {
                         error_message.status = http::status::HTTP_STATUS_NOT_FOUND;
                     }
-                    header = error_message.build_header();
-                    auto size = co_await sock_.send(header.data(), header.size(), ct_);
-                    assert(size == header.size());
-                    auto body = co_await to_send.read_body();
-                    size = co_await sock_.send(body.data(), body.size(), ct_);
-                    assert(size == body.size());
+                    sent_status = error_message.status;
+                    header_.clear();
+                    error_message.build_header(header_);
+                    auto &body = error_message.body_access;
+                    // responses queued for previous pipelined requests go first
+                    std::array buffers{
+                        iovec{pending_output_.data(), pending_output_.size()},
+                        iovec{header_.data(), header_.size()},
+                        iovec{body.data(), body.size()},
+                    };
+                    count_sent(co_await send_vectored(buffers), pending_output_.size() + header_.size() + body.size());
+                    pending_output_.clear();
                 } else {
                     throw;
                 }
@@ -199,27 +407,166 @@ namespace cppcoro::http {
 
     private:
 
+        void count_sent(size_t size) noexcept {
+            if constexpr (is_server()) {
+                metrics::local().bytes_out.add(size);
+            }
+        }
+
+        /**
+         * @brief Account for @a size bytes sent out of @a expected.
+         *
+         * Throws connection_aborted on a short write: the peer got part of a message, the stream cannot be
+         * resynchronized and the connection is to be closed.
+         */
+        void count_sent(size_t size, size_t expected) {
+            count_sent(size);
+            if (size != expected) {
+                logger_.error("message not sent ({}/{})", size, expected);
+                throw std::system_error{std::make_error_code(std::errc::connection_aborted), "message truncated"};
+            }
+        }
 
-        template<http::method _method>
-        task<std::optional<receive_type>> _send(std::string &&path, std::string &&data = "") requires(is_client()) {
+        /**
+         * @brief Zero-copy file body transfer.
+         *
+         * The body is sent with a Content-Length header, straight from the file descriptor.
+         * Returns false when the file cannot be opened, so the caller falls back to the chunked path.
+         * Throws when the body cannot be sent in full: the connection is to be closed.
+         */
+        tcp::connection_task<bool> send_file(http::detail::base_message &to_send, std::string_view path) {
+            struct file_descriptor {
+                int fd;
+                ~file_descriptor() {
+                    if (fd >= 0) ::close(fd);
+                }
+            } file{::open(std::string{path}.c_str(), O_RDONLY | O_CLOEXEC)};
+            struct stat st{};
+            if (file.fd < 0 or ::fstat(file.fd, &st) < 0 or not S_ISREG(st.st_mode)) {
+                co_return false;
+            }
+            const auto size = size_t(st.st_size);
+            to_send.headers.set("Content-Length", std::to_string(size));
+            header_.clear();
+            to_send.build_header(header_);
+            std::array buffers{
+                iovec{pending_output_.data(), pending_output_.size()},
+                iovec{header_.data(), header_.size()},
+            };
+            count_sent(co_await send_vectored(buffers, MSG_MORE), pending_output_.size() + header_.size());
+            pending_output_.clear();
+            logger_.debug("zero-copy body: {} ({} bytes)", path, size);
+            auto sent = co_await tcp::connection::send_file(file.fd, size);
+            count_sent(sent);
+            if (sent != size) {
+                // the Content-Length is out: the stream cannot be resynchronized
+                logger_.error("body not sent ({}/{})", sent, size);
+                throw std::system_error{std::make_error_code(std::errc::connection_aborted), "file body truncated"};
+            }
+            co_return true;
+        }
+
+        /**
+         * @brief Load what the parser got into @a message.
+         */
+        tcp::connection_task<> load(base_receive_type &message) {
+            parser_.load_head(message);
+            for (auto &fragment : parser_.body()) {
+                if (not message.append_body(fragment)) {
+                    co_await message.write_body(fragment);
+                }
+            }
+        }
+
+        /**
+         * @brief Send a request and receive its response.
+         *
+         * Concurrent calls are pipelined: requests are written one after the other without waiting for
+         * the responses, which are read back in request order.
+         * A request that cannot be written or which response cannot be read aborts the pipeline: the connection
+         * is shut down and the requests queued behind it fail with connection_aborted.
+         */
+        template<http::method _method, typename ResponseBodyT = typename receive_type::body_type,
+            typename ResponseT = std::conditional_t<std::is_same_v<ResponseBodyT, typename receive_type::body_type>,
+                receive_type, abstract_response<ResponseBodyT>>>
+        tcp::connection_task<std::optional<ResponseT>> _send(std::string path, std::string data = {},
+                                                            ResponseBodyT body = {}) requires(is_client()) {
             send_type request{
                 _method,
-                std::forward<std::string>(path),
-                std::forward<std::string>(data),
+                std::move(path),
+                std::move(data),
                 {}
             };
-            co_await send(request);
-            receive_type response{http::status::HTTP_STATUS_NOT_FOUND};
-            auto resp = co_await next([&](const http::response_parser &) -> receive_type & {
-                return response;
+            auto &pipeline = *pipeline_;
+            size_t ticket;
+            std::exception_ptr error;
+            {
+                auto lock = co_await pipeline.write_mutex.scoped_lock_async();
+                ticket = pipeline.next_ticket++;
+                if (not pipeline.aborted) {
+                    try {
+                        co_await send(request);
+                    } catch (...) {
+                        error = std::current_exception();
+                        abort_pipeline(); // the request may be partly written: the stream is out of sync
+                    }
+                }
+            }
+            // wait for the responses of the previous requests, even on error: readers are chained
+            co_await pipeline.read_barrier.wait_until_published(ticket - 1, parent_.service());
+            auto _ = on_scope_exit([&] {
+                pipeline.read_barrier.publish(ticket);
             });
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if (pipeline.aborted) {
+                throw std::system_error{std::make_error_code(std::errc::connection_aborted), "pipeline aborted"};
+            }
+            ResponseT response{http::status::HTTP_STATUS_NOT_FOUND, std::move(body)};
+            ResponseT *resp;
+            try {
+                resp = co_await next([&](const http::response_parser &) -> ResponseT & {
+                    return response;
+                });
+            } catch (...) {
+                abort_pipeline();
+                throw;
+            }
             if (resp) {
-                co_return std::optional<receive_type>{std::move(*resp)};
+                co_return std::optional<ResponseT>{std::move(*resp)};
             }
-            co_return std::optional<receive_type>{};
+            abort_pipeline(); // closed by the peer: no response will come for the next requests either
+            co_return std::optional<ResponseT>{};
         }
 
+        void abort_pipeline() {
+            if (not pipeline_->aborted.exchange(true)) {
+                shutdown();
+                logger_.warn("pipeline aborted");
+            }
+        }
+
+        static constexpr size_t max_pending_output = 64 * 1024;
+
         std::vector<char> buffer_;
+        size_t input_begin_ = 0;
+        size_t input_end_ = 0;
+        std::string pending_output_;
+        std::string header_; // reused for each outgoing message
+        parser_type parser_; // reused for each incoming message
+        std::chrono::steady_clock::time_point received_at_{};
+        std::chrono::steady_clock::duration send_time_{};
+
+        // client request pipelining
+        struct pipeline
+        {
+            async_mutex write_mutex;
+            size_t next_ticket = 0;
+            sequence_barrier<size_t> read_barrier; // last ticket which response was read
+            std::atomic<bool> aborted = false; // requests behind a failed one fail without touching the stream
+        };
+        std::unique_ptr<pipeline> pipeline_; // stable address: pending requests refer to it
         ParentT &parent_;
         // std::unique_ptr<receive_type> input_;
     };
@@ -0,0 +1,323 @@
+/**
+ * @file cppcoro/http/http_headers.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cppcoro::http {
+
+    namespace detail {
+        constexpr char ascii_lower(char c) noexcept {
+            return (c >= 'A' and c <= 'Z') ? char(c - 'A' + 'a') : c;
+        }
+
+        constexpr bool iequals(std::string_view lhs, std::string_view rhs) noexcept {
+            return lhs.size() == rhs.size() and std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) {
+                return ascii_lower(l) == ascii_lower(r);
+            });
+        }
+    }
+
+    /**
+     * @brief Flat header container.
+     *
+     * Names and values are stored back to back in one buffer owned by the message, and indexed by a flat vector
+     * of offsets: a message costs two allocations whatever its header count (none when reused).
+     * Lookups are case-insensitive, fields keep their insertion (wire) order.
+     * Bytes of replaced or erased fields are reclaimed once they make up half of the buffer.
+     */
+    class headers
+    {
+        struct entry
+        {
+            uint32_t name_offset;
+            uint32_t name_size;
+            uint32_t value_offset;
+            uint32_t value_size;
+        };
+
+    public:
+        using value_type = std::pair<std::string_view, std::string_view>;
+
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = headers::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            iterator() = default;
+
+            value_type operator*() const noexcept {
+                return owner_->view(*it_);
+            }
+
+            iterator &operator++() noexcept {
+                ++it_;
+                return *this;
+            }
+
+            iterator operator++(int) noexcept {
+                auto tmp = *this;
+                ++it_;
+                return tmp;
+            }
+
+            bool operator==(const iterator &other) const noexcept {
+                return it_ == other.it_;
+            }
+
+        private:
+            friend class headers;
+
+            iterator(const headers *owner, std::vector<entry>::const_iterator it) noexcept
+                : owner_{owner}, it_{it} {}
+
+            const headers *owner_ = nullptr;
+            std::vector<entry>::const_iterator it_;
+        };
+
+        headers() = default;
+
+        headers(std::initializer_list<value_type> init) {
+            for (auto [name, value] : init) {
+                add(name, value);
+            }
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return entries_.empty();
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return entries_.size();
+        }
+
+        /**
+         * @brief Bytes used in the buffer, reclaimable ones included.
+         */
+        [[nodiscard]] size_t storage_size() const noexcept {
+            return storage_.size();
+        }
+
+        [[nodiscard]] iterator begin() const noexcept {
+            return {this, entries_.begin()};
+        }
+
+        [[nodiscard]] iterator end() const noexcept {
+            return {this, entries_.end()};
+        }
+
+        [[nodiscard]] iterator find(std::string_view name) const noexcept {
+            return {this, std::find_if(entries_.begin(), entries_.end(), [&](const entry &e) {
+                return detail::iequals(name_of(e), name);
+            })};
+        }
+
+        [[nodiscard]] bool contains(std::string_view name) const noexcept {
+            return find(name) != end();
+        }
+
+        /**
+         * @brief Mutable access to the first @a name field, as with the former map (ie.: headers["X"] = "v").
+         *
+         * Reading a missing field gives an empty value without adding it.
+         */
+        class field_reference
+        {
+        public:
+            field_reference &operator=(std::string_view value) {
+                owner_.set(name_, value);
+                return *this;
+            }
+
+            [[nodiscard]] std::string_view value() const noexcept {
+                return std::as_const(owner_)[name_];
+            }
+
+            operator std::string_view() const noexcept {
+                return value();
+            }
+
+            friend bool operator==(const field_reference &lhs, std::string_view rhs) noexcept {
+                return lhs.value() == rhs;
+            }
+
+        private:
+            friend class headers;
+
+            field_reference(headers &owner, std::string_view name) noexcept
+                : owner_{owner}, name_{name} {}
+
+            headers &owner_;
+            std::string_view name_;
+        };
+
+        /**
+         * @brief Value of the first @a name field, empty when there is none.
+         */
+        std::string_view operator[](std::string_view name) const noexcept {
+            auto it = find(name);
+            return it != end() ? (*it).second : std::string_view{};
+        }
+
+        field_reference operator[](std::string_view name) noexcept {
+            return {*this, name};
+        }
+
+        /**
+         * @brief Append a @a name field (duplicates allowed).
+         */
+        void add(std::string_view name, std::string_view value) {
+            reserve();
+            entry e{};
+            e.name_offset = uint32_t(storage_.size());
+            e.name_size = uint32_t(name.size());
+            storage_.append(name);
+            e.value_offset = uint32_t(storage_.size());
+            e.value_size = uint32_t(value.size());
+            storage_.append(value);
+            entries_.push_back(e);
+        }
+
+        /**
+         * @brief Set the value of the first @a name field, adding it when missing.
+         */
+        void set(std::string_view name, std::string_view value) {
+            auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry &e) {
+                return detail::iequals(name_of(e), name);
+            });
+            if (it == entries_.end()) {
+                add(name, value);
+            } else if (value.size() <= it->value_size) {
+                std::copy(value.begin(), value.end(), storage_.begin() + it->value_offset);
+                garbage_ += it->value_size - value.size();
+                it->value_size = uint32_t(value.size());
+            } else {
+                if (it->value_offset + it->value_size == storage_.size()) {
+                    storage_.resize(it->value_offset); // last value of the buffer: grown in place
+                } else {
+                    garbage_ += it->value_size;
+                }
+                it->value_offset = uint32_t(storage_.size());
+                it->value_size = uint32_t(value.size());
+                storage_.append(value);
+                if (garbage_ * 2 > storage_.size()) {
+                    compact();
+                }
+            }
+        }
+
+        /**
+         * @brief Add a @a name field only when missing.
+         * @return true when added.
+         */
+        bool try_emplace(std::string_view name, std::string_view value) {
+            if (contains(name)) {
+                return false;
+            }
+            add(name, value);
+            return true;
+        }
+
+        size_t erase(std::string_view name) noexcept {
+            auto first = std::remove_if(entries_.begin(), entries_.end(), [&](const entry &e) {
+                if (not detail::iequals(name_of(e), name)) {
+                    return false;
+                }
+                garbage_ += e.name_size + e.value_size;
+                return true;
+            });
+            auto count = size_t(std::distance(first, entries_.end()));
+            entries_.erase(first, entries_.end());
+            return count;
+        }
+
+        /**
+         * @brief Remove all fields, keeping allocated capacity for reuse.
+         */
+        void clear() noexcept {
+            entries_.clear();
+            storage_.clear();
+            garbage_ = 0;
+        }
+
+        /**
+         * @brief Incremental building (ie.: by the parser).
+         *
+         * Append @a fragment to the name of a new field when @a new_field is set, to the name of the last field otherwise.
+         */
+        void append_field(std::string_view fragment, bool new_field) {
+            if (new_field or entries_.empty()) {
+                reserve();
+                entries_.push_back({uint32_t(storage_.size()), 0, uint32_t(storage_.size()), 0});
+            }
+            auto &last = entries_.back();
+            storage_.append(fragment);
+            last.name_size += uint32_t(fragment.size());
+            last.value_offset = uint32_t(storage_.size());
+        }
+
+        /**
+         * @brief Incremental building: append @a fragment to the value of the last field.
+         */
+        void append_value(std::string_view fragment) {
+            if (entries_.empty()) {
+                return;
+            }
+            storage_.append(fragment);
+            entries_.back().value_size += uint32_t(fragment.size());
+        }
+
+    private:
+        static constexpr size_t default_field_count = 16;
+        static constexpr size_t default_storage_size = 512;
+
+        void reserve() {
+            if (entries_.capacity() == 0) {
+                entries_.reserve(default_field_count);
+                storage_.reserve(default_storage_size);
+            }
+        }
+
+        /**
+         * @brief Rebuild the buffer with the live fields only, in field order.
+         */
+        void compact() {
+            std::string storage;
+            storage.reserve(storage_.capacity());
+            for (auto &e : entries_) {
+                auto [name, value] = view(e);
+                e.name_offset = uint32_t(storage.size());
+                storage.append(name);
+                e.value_offset = uint32_t(storage.size());
+                storage.append(value);
+            }
+            storage_.swap(storage);
+            garbage_ = 0;
+        }
+
+        [[nodiscard]] std::string_view name_of(const entry &e) const noexcept {
+            return {storage_.data() + e.name_offset, e.name_size};
+        }
+
+        [[nodiscard]] value_type view(const entry &e) const noexcept {
+            return {name_of(e), {storage_.data() + e.value_offset, e.value_size}};
+        }
+
+        std::vector<entry> entries_;
+        std::string storage_;
+        size_t garbage_ = 0; // bytes of replaced or erased fields
+    };
+}
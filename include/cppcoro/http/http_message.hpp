@@ -5,6 +5,7 @@
 #pragma once
 
 #include <cppcoro/http/details/static_parser_handler.hpp>
+#include <cppcoro/http/details/header_serializer.hpp>
 
 #include <fmt/format.h>
 
@@ -32,9 +33,26 @@ namespace cppcoro::http {
             http::headers headers;
 
             virtual bool is_chunked() = 0;
-            virtual std::string build_header() = 0;
+            virtual std::string_view file_path() = 0;
+            /**
+             * @brief Append the serialized header to @a output.
+             */
+            virtual void build_header(std::string &output) = 0;
+
+            std::string build_header() {
+                std::string output;
+                build_header(output);
+                return output;
+            }
+
             virtual task<std::string_view> read_body(size_t max_size = max_body_size) = 0;
             virtual task<size_t> write_body(std::string_view data) = 0;
+
+            /**
+             * @brief Append @a data to a basic body in place.
+             * @return false when the body is chunked: write_body must be used.
+             */
+            virtual bool append_body(std::string_view data) = 0;
         };
 
         struct base_request : base_message
@@ -115,11 +133,30 @@ namespace cppcoro::http {
 //                static_cast<base_type>(*this) = std::move(base);
 //            }
 
+            static constexpr bool chunked = ro_chunked_body<body_type> or wo_chunked_body<body_type>;
+
+            /**
+             * @brief Reset the message for reuse, keeping allocated storage.
+             */
+            void clear() requires requires(BodyT &body) { body.clear(); } {
+                this->headers.clear();
+                if constexpr (is_request) {
+                    this->path.clear();
+                }
+                body_access.clear();
+                chunk_generator_it_.reset();
+                chunk_generator_.reset();
+            }
+
             bool is_chunked() final {
-                if constexpr (ro_chunked_body<body_type> or wo_chunked_body<body_type>) {
-                    return true;
+                return chunked;
+            }
+
+            std::string_view file_path() final {
+                if constexpr (ro_file_body<body_type>) {
+                    return body_access.path();
                 } else {
-                    return false;
+                    return {};
                 }
             }
 
@@ -140,6 +177,15 @@ namespace cppcoro::http {
                 }
             }
 
+            bool append_body(std::string_view data) final {
+                if constexpr (wo_basic_body<BodyT>) {
+                    this->body_access.append(data);
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+
             task<size_t> write_body(std::string_view data) final {
                 if constexpr (wo_basic_body<BodyT>) {
                     auto size = data.size();
@@ -150,36 +196,55 @@ namespace cppcoro::http {
                 }
             }
 
-            inline std::string build_header() final {
-                std::string output = _header_base();
-                auto write_header = [&output](const std::string &field, const std::string &value) {
-                    output += fmt::format("{}: {}\r\n", field, value);
-                };
-                if constexpr (ro_basic_body<BodyT>) {
-                    this->headers["Content-Length"] = std::to_string(this->body_access.size());
-                } else if constexpr (ro_chunked_body<BodyT>) {
-                    this->headers["Transfer-Encoding"] = "chunked";
-                }
-                for (auto &[field, value] : this->headers) {
-                    write_header(field, value);
-                }
-                output += "\r\n";
-                return output;
-            }
+            using base_type::build_header;
 
-        private:
-            inline auto _header_base() {
+            /**
+             * @brief Serialize the header into @a output.
+             *
+             * Framing fields (Content-Length, Transfer-Encoding) are computed from the body, the status line
+             * and Date field come pre-rendered: nothing is formatted nor inserted into the header map.
+             * Chunked bodies are sent with chunk framing, unless a Content-Length is given: they are sent raw then.
+             */
+            void build_header(std::string &output) final {
                 if constexpr (is_response) {
-                    return fmt::format("HTTP/1.1 {} {}\r\n"
-                                       "UserAgent: cppcoro-http/0.0\r\n",
-                                       int(this->status),
-                                       http_status_str(this->status));
+                    if (auto line = status_line(this->status); not line.empty()) {
+                        output.append(line);
+                    } else {
+                        output.append(fmt::format("HTTP/1.1 {} {}\r\n",
+                                                  int(this->status),
+                                                  http_status_str(this->status)));
+                    }
+                    if (not this->headers.contains("Date")) {
+                        output.append(date_header());
+                    }
                 } else {
-                    return fmt::format("{} {} HTTP/1.1\r\n"
-                                       "UserAgent: cppcoro-http/0.0\r\n",
-                                       this->method_str(),
-                                       this->path);
+                    output.append(this->method_str()).append(" ").append(this->path).append(" HTTP/1.1\r\n");
+                    if (not this->headers.contains("User-Agent")) {
+                        output.append("User-Agent: cppcoro-http/0.0\r\n");
+                    }
+                }
+                for (auto [field, value] : this->headers) {
+                    if constexpr (ro_basic_body<BodyT>) {
+                        if (iequals(field, "Content-Length")) {
+                            continue;
+                        }
+                    } else if constexpr (ro_chunked_body<BodyT>) {
+                        if (iequals(field, "Transfer-Encoding")) {
+                            continue;
+                        }
+                    }
+                    append_header(output, field, value);
+                }
+                if constexpr (ro_basic_body<BodyT>) {
+                    output.append("Content-Length: ");
+                    append_number(output, this->body_access.size());
+                    output.append("\r\n");
+                } else if constexpr (ro_chunked_body<BodyT>) {
+                    if (not this->headers.contains("Content-Length")) {
+                        output.append("Transfer-Encoding: chunked\r\n");
+                    }
                 }
+                output.append("\r\n");
             }
         };
 
@@ -20,6 +20,8 @@ namespace cppcoro::http {
         using tcp::server::server;
         using tcp::server::stop;
         using tcp::server::service;
+        using tcp::server::timeouts;
+        using tcp::server::local_endpoint;
         using connection_type = connection<server>;
 
         task<connection_type> listen() {
@@ -0,0 +1,370 @@
+/**
+ * @file cppcoro/http/metrics.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cppcoro::http {
+
+    namespace detail {
+
+        static constexpr size_t cache_line_size = 64;
+
+        /**
+         * @brief Value written by a single thread, read by any.
+         *
+         * Updates are a relaxed load and store, not a read-modify-write: no lock prefix, no cache line
+         * bouncing between cores. Readers see a possibly stale but never torn value.
+         */
+        template<typename T>
+        class local_value
+        {
+        public:
+            void add(T value = 1) noexcept {
+                value_.store(value_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+
+            void sub(T value = 1) noexcept {
+                value_.store(value_.load(std::memory_order_relaxed) - value, std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] T load() const noexcept {
+                return value_.load(std::memory_order_relaxed);
+            }
+
+        private:
+            std::atomic<T> value_{0};
+        };
+
+        using local_counter = local_value<uint64_t>;
+        using local_gauge = local_value<int64_t>; // a coroutine may leave a thread's gauge negative, sums are right
+
+        /**
+         * @brief Bucket upper bounds of latency histograms.
+         */
+        static constexpr std::array<std::chrono::nanoseconds, 22> latency_buckets{
+            std::chrono::nanoseconds{1'000}, std::chrono::nanoseconds{2'500}, std::chrono::nanoseconds{5'000},
+            std::chrono::nanoseconds{10'000}, std::chrono::nanoseconds{25'000}, std::chrono::nanoseconds{50'000},
+            std::chrono::nanoseconds{100'000}, std::chrono::nanoseconds{250'000}, std::chrono::nanoseconds{500'000},
+            std::chrono::nanoseconds{1'000'000}, std::chrono::nanoseconds{2'500'000},
+            std::chrono::nanoseconds{5'000'000}, std::chrono::nanoseconds{10'000'000},
+            std::chrono::nanoseconds{25'000'000}, std::chrono::nanoseconds{50'000'000},
+            std::chrono::nanoseconds{100'000'000}, std::chrono::nanoseconds{250'000'000},
+            std::chrono::nanoseconds{500'000'000}, std::chrono::nanoseconds{1'000'000'000},
+            std::chrono::nanoseconds{2'500'000'000}, std::chrono::nanoseconds{5'000'000'000},
+            std::chrono::nanoseconds{10'000'000'000},
+        };
+
+        struct latency_histogram
+        {
+            std::array<local_counter, latency_buckets.size() + 1> buckets; // the last one is +Inf
+            local_counter sum; // nanoseconds
+            local_counter count;
+
+            void record(std::chrono::nanoseconds duration) noexcept {
+                const auto bucket = std::lower_bound(latency_buckets.begin(), latency_buckets.end(), duration);
+                buckets[size_t(bucket - latency_buckets.begin())].add();
+                sum.add(uint64_t(std::max<int64_t>(duration.count(), 0)));
+                count.add();
+            }
+        };
+
+        /**
+         * @brief Metrics recorded by a single thread.
+         */
+        struct alignas(cache_line_size) metrics_shard
+        {
+            static constexpr size_t max_routes = 128;
+            static constexpr size_t min_status = 100;
+            static constexpr size_t max_status = 600;
+
+            local_counter accepted_connections;
+            local_gauge active_connections;
+            local_counter requests;
+            local_gauge active_requests;
+            local_counter bytes_in;
+            local_counter bytes_out;
+            std::array<local_counter, max_routes> routes;
+            std::array<local_counter, max_status> statuses;
+            local_counter other_statuses; // out of [min_status, max_status)
+            latency_histogram parse_latency;
+            latency_histogram handler_latency;
+            latency_histogram send_latency;
+
+            void route(size_t index) noexcept {
+                routes[std::min(index, max_routes - 1)].add();
+            }
+
+            void status(int status) noexcept {
+                if (size_t(status) >= min_status and size_t(status) < max_status) {
+                    statuses[size_t(status)].add();
+                } else {
+                    other_statuses.add();
+                }
+            }
+        };
+    }
+
+    /**
+     * @brief Server metrics.
+     *
+     * Each thread records into its own cache-line aligned shard, shards are only merged when collected:
+     * recording never writes memory another core writes to.
+     */
+    class metrics
+    {
+    public:
+        struct histogram_snapshot
+        {
+            std::array<uint64_t, detail::latency_buckets.size() + 1> buckets{};
+            uint64_t sum = 0; // nanoseconds
+            uint64_t count = 0;
+        };
+
+        /**
+         * @brief Merged metrics.
+         */
+        struct snapshot
+        {
+            uint64_t accepted_connections = 0;
+            int64_t active_connections = 0;
+            uint64_t requests = 0;
+            int64_t active_requests = 0;
+            uint64_t bytes_in = 0;
+            uint64_t bytes_out = 0;
+            std::vector<std::pair<std::string, uint64_t>> routes;
+            std::vector<std::pair<int, uint64_t>> statuses;
+            uint64_t other_statuses = 0; ///< responses which status is not a valid HTTP status code
+            histogram_snapshot parse_latency;
+            histogram_snapshot handler_latency;
+            histogram_snapshot send_latency;
+
+            [[nodiscard]] uint64_t route(std::string_view name) const noexcept {
+                auto it = std::find_if(routes.begin(), routes.end(), [name](auto &route) {
+                    return route.first == name;
+                });
+                return it != routes.end() ? it->second : 0;
+            }
+
+            [[nodiscard]] uint64_t status(int status) const noexcept {
+                auto it = std::find_if(statuses.begin(), statuses.end(), [status](auto &entry) {
+                    return entry.first == status;
+                });
+                return it != statuses.end() ? it->second : 0;
+            }
+        };
+
+        /// label of requests no route matched
+        static constexpr std::string_view unmatched_route = "<unmatched>";
+
+        /**
+         * @brief Process-wide metrics.
+         */
+        static metrics &global() {
+            static auto *instance = new metrics; // never destroyed: threads may outlive static destruction
+            return *instance;
+        }
+
+        /**
+         * @brief Shard of the calling thread.
+         */
+        static detail::metrics_shard &local() {
+            thread_local shard_holder holder{global()};
+            return *holder.shard;
+        }
+
+        /**
+         * @brief Index of the route labelled @a name, registered on first use.
+         *
+         * Routes past metrics_shard::max_routes share the last index.
+         */
+        size_t route(std::string_view name) {
+            std::scoped_lock lock{mutex_};
+            auto it = std::find(route_names_.begin(), route_names_.end(), name);
+            if (it != route_names_.end()) {
+                return size_t(it - route_names_.begin());
+            }
+            if (route_names_.size() == detail::metrics_shard::max_routes - 1) {
+                route_names_.emplace_back("<other>");
+            }
+            if (route_names_.size() == detail::metrics_shard::max_routes) {
+                return detail::metrics_shard::max_routes - 1;
+            }
+            route_names_.emplace_back(name);
+            return route_names_.size() - 1;
+        }
+
+        /**
+         * @brief Merge all shards.
+         */
+        [[nodiscard]] snapshot collect() const {
+            std::scoped_lock lock{mutex_};
+            snapshot result;
+            std::array<uint64_t, detail::metrics_shard::max_routes> routes{};
+            std::array<uint64_t, detail::metrics_shard::max_status> statuses{};
+            for (auto &shard : shards_) {
+                result.accepted_connections += shard->accepted_connections.load();
+                result.active_connections += shard->active_connections.load();
+                result.requests += shard->requests.load();
+                result.active_requests += shard->active_requests.load();
+                result.bytes_in += shard->bytes_in.load();
+                result.bytes_out += shard->bytes_out.load();
+                for (size_t ii = 0; ii < routes.size(); ++ii) {
+                    routes[ii] += shard->routes[ii].load();
+                }
+                for (size_t ii = 0; ii < statuses.size(); ++ii) {
+                    statuses[ii] += shard->statuses[ii].load();
+                }
+                result.other_statuses += shard->other_statuses.load();
+                merge(result.parse_latency, shard->parse_latency);
+                merge(result.handler_latency, shard->handler_latency);
+                merge(result.send_latency, shard->send_latency);
+            }
+            for (size_t ii = 0; ii < route_names_.size(); ++ii) {
+                result.routes.emplace_back(route_names_[ii], routes[ii]);
+            }
+            for (size_t ii = 0; ii < statuses.size(); ++ii) {
+                if (statuses[ii]) {
+                    result.statuses.emplace_back(int(ii), statuses[ii]);
+                }
+            }
+            return result;
+        }
+
+        /**
+         * @brief Prometheus text exposition format (version 0.0.4).
+         */
+        [[nodiscard]] std::string render() const {
+            const auto values = collect();
+            std::string output;
+            auto out = std::back_inserter(output);
+            auto metric = [&](std::string_view name, std::string_view type, std::string_view help, auto value) {
+                fmt::format_to(out, "# HELP {0} {1}\n# TYPE {0} {2}\n{0} {3}\n", name, help, type, value);
+            };
+            metric("http_server_connections_accepted_total", "counter", "Accepted connections.",
+                   values.accepted_connections);
+            metric("http_server_connections_active", "gauge", "Open connections.", values.active_connections);
+            metric("http_server_requests_total", "counter", "Received requests.", values.requests);
+            metric("http_server_requests_active", "gauge", "Requests being processed.", values.active_requests);
+            metric("http_server_received_bytes_total", "counter", "Bytes received.", values.bytes_in);
+            metric("http_server_sent_bytes_total", "counter", "Bytes sent.", values.bytes_out);
+
+            fmt::format_to(out, "# HELP http_server_route_requests_total Requests by route.\n"
+                                "# TYPE http_server_route_requests_total counter\n");
+            for (auto &[route, count] : values.routes) {
+                fmt::format_to(out, "http_server_route_requests_total{{route=\"{}\"}} {}\n", escape(route), count);
+            }
+            fmt::format_to(out, "# HELP http_server_responses_total Responses by status code.\n"
+                                "# TYPE http_server_responses_total counter\n");
+            for (auto [status, count] : values.statuses) {
+                fmt::format_to(out, "http_server_responses_total{{status=\"{}\"}} {}\n", status, count);
+            }
+            if (values.other_statuses) {
+                fmt::format_to(out, "http_server_responses_total{{status=\"other\"}} {}\n", values.other_statuses);
+            }
+
+            auto histogram = [&](std::string_view name, std::string_view help, const histogram_snapshot &values) {
+                fmt::format_to(out, "# HELP {0} {1}\n# TYPE {0} histogram\n", name, help);
+                uint64_t cumulative = 0;
+                for (size_t ii = 0; ii < detail::latency_buckets.size(); ++ii) {
+                    cumulative += values.buckets[ii];
+                    fmt::format_to(out, "{}_bucket{{le=\"{}\"}} {}\n", name,
+                                   std::chrono::duration<double>(detail::latency_buckets[ii]).count(), cumulative);
+                }
+                cumulative += values.buckets.back();
+                // shards are read while being written: the count is derived from the buckets to stay consistent
+                fmt::format_to(out, "{0}_bucket{{le=\"+Inf\"}} {1}\n{0}_sum {2}\n{0}_count {1}\n", name, cumulative,
+                               double(values.sum) / 1e9);
+            };
+            histogram("http_server_parse_duration_seconds", "Time spent parsing requests.", values.parse_latency);
+            histogram("http_server_handler_duration_seconds", "Time spent in request handlers, sending excluded.",
+                      values.handler_latency);
+            histogram("http_server_send_duration_seconds", "Time spent sending responses.", values.send_latency);
+            return output;
+        }
+
+    private:
+        metrics() {
+            route_names_.emplace_back(unmatched_route);
+        }
+
+        /**
+         * @brief Gives a shard to a thread, the shard goes back to the pool when the thread exits.
+         *
+         * Shards are never destroyed: counters of exited threads are kept and carried on by the next ones.
+         */
+        struct shard_holder
+        {
+            explicit shard_holder(metrics &owner) : owner{owner}, shard{owner.acquire()} {}
+
+            ~shard_holder() {
+                owner.release(*shard);
+            }
+
+            metrics &owner;
+            detail::metrics_shard *shard;
+        };
+
+        detail::metrics_shard *acquire() {
+            std::scoped_lock lock{mutex_};
+            if (not free_.empty()) {
+                auto *shard = free_.back();
+                free_.pop_back();
+                return shard;
+            }
+            return shards_.emplace_back(std::make_unique<detail::metrics_shard>()).get();
+        }
+
+        void release(detail::metrics_shard &shard) {
+            std::scoped_lock lock{mutex_};
+            free_.push_back(&shard);
+        }
+
+        static void merge(histogram_snapshot &output, const detail::latency_histogram &input) noexcept {
+            for (size_t ii = 0; ii < output.buckets.size(); ++ii) {
+                output.buckets[ii] += input.buckets[ii].load();
+            }
+            output.sum += input.sum.load();
+            output.count += input.count.load();
+        }
+
+        static std::string escape(std::string_view label) {
+            std::string result;
+            result.reserve(label.size());
+            for (auto c : label) {
+                switch (c) {
+                    case '\\':
+                        result.append("\\\\");
+                        break;
+                    case '"':
+                        result.append("\\\"");
+                        break;
+                    case '\n':
+                        result.append("\\n");
+                        break;
+                    default:
+                        result.push_back(c);
+                }
+            }
+            return result;
+        }
+
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<detail::metrics_shard>> shards_;
+        std::vector<detail::metrics_shard *> free_;
+        std::vector<std::string> route_names_;
+    };
+}
@@ -0,0 +1,36 @@
+/**
+ * @file cppcoro/http/metrics_controller.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/metrics.hpp>
+#include <cppcoro/http/route_controller.hpp>
+
+#include <variant>
+
+namespace cppcoro::http {
+
+    /**
+     * @brief Serves metrics::global() in Prometheus text format on @a route.
+     *
+     * Works with any controller_server session type, ie.:
+     * @code
+     * http::controller_server<session, hello_controller, http::metrics_controller> server{ios, endpoint};
+     * @endcode
+     */
+    template<ctll::fixed_string route = "/metrics">
+    struct basic_metrics_controller : route_controller<route, std::monostate, string_request,
+                                                       basic_metrics_controller<route>>
+    {
+        explicit basic_metrics_controller(io_service &service)
+            : route_controller<route, std::monostate, string_request, basic_metrics_controller<route>>{service} {}
+
+        auto on_get() -> task<string_response> {
+            co_return string_response{http::status::HTTP_STATUS_OK, metrics::global().render(),
+                                      {{"Content-Type", "text/plain; version=0.0.4"}}};
+        }
+    };
+
+    using metrics_controller = basic_metrics_controller<>;
+}
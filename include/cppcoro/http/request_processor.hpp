@@ -1,14 +1,83 @@
 /**
- * @file cppcoro/http/route_controller.hpp
+ * @file cppcoro/http/request_processor.hpp
  * @author Sylvain Garcia <garcia.6l20@gmail.com>
  */
 #pragma once
 
 #include <cppcoro/http/http_server.hpp>
+#include <cppcoro/http/http_request.hpp>
+#include <cppcoro/http/http_response.hpp>
+#include <cppcoro/http/metrics.hpp>
+#include <cppcoro/http/details/codel.hpp>
 #include <cppcoro/async_scope.hpp>
+#include <cppcoro/async_auto_reset_event.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <map>
+#include <mutex>
 
 namespace cppcoro::http {
 
+    namespace detail {
+        template<typename ProcessorT, typename SessionT>
+        concept session_processor = requires(ProcessorT &processor,
+                                             base_request &request,
+                                             server::connection_type &connection,
+                                             SessionT &session) {
+            processor.process(request, connection, session);
+        };
+    }
+
+    /**
+     * @brief Admission limits of a request_processor, zero meaning unlimited.
+     */
+    struct admission_limits
+    {
+        enum class policy
+        {
+            pause,  ///< stop accepting (connections) or wait (requests) until a slot is released
+            reject, ///< answer 503 and close the connection
+        };
+
+        size_t max_connections = 0;
+        size_t max_requests = 0; ///< in flight, all connections together
+        size_t max_connections_per_peer = 0; ///< always rejected when reached
+        policy overload = policy::pause;
+
+        /// CoDel load shedding: queueing delay to keep requests under, zero disables it
+        std::chrono::microseconds queue_delay_target{0};
+        /// CoDel load shedding: how long the delay may stay above the target
+        std::chrono::microseconds queue_delay_interval = std::chrono::milliseconds{100};
+        /// advertised to shed requests
+        std::chrono::seconds retry_after{1};
+    };
+
+    /**
+     * @brief Admission counters of a request_processor.
+     */
+    struct admission_stats
+    {
+        std::atomic<size_t> connections = 0; ///< open connections
+        std::atomic<size_t> requests = 0; ///< requests in flight
+        std::atomic<size_t> paused_accepts = 0;
+        std::atomic<size_t> rejected_connections = 0;
+        std::atomic<size_t> rejected_peer_connections = 0;
+        std::atomic<size_t> paused_requests = 0;
+        std::atomic<size_t> rejected_requests = 0;
+        std::atomic<size_t> shed_requests = 0;
+    };
+
+    /**
+     * @brief Request processor.
+     *
+     * @a ProcessorT provides:
+     *  - base_request *prepare(const request_parser &, SessionT &): the request to load the incoming message into,
+     *  - tcp::connection_task<> process(base_request &, server::connection_type &[, SessionT &]): process and send the response.
+     */
     template<typename SessionT, typename ProcessorT>
     class request_processor : public server
     {
@@ -16,43 +85,212 @@ namespace cppcoro::http {
         using session_type = SessionT;
         using server::server;
 
+        /**
+         * @brief Limits applied from now on.
+         */
+        void limits(const admission_limits &limits) noexcept {
+            limits_ = limits;
+        }
+
+        [[nodiscard]] const admission_limits &limits() const noexcept {
+            return limits_;
+        }
+
+        [[nodiscard]] const admission_stats &stats() const noexcept {
+            return stats_;
+        }
+
         task<> serve() {
             async_scope scope;
+            scope.spawn(supervise());
             try {
                 while (true) {
-                    auto conn = co_await listen();
-                    scope.spawn([](server *srv, http::server::connection_type conn) mutable -> task<> {
-                        session_type session{};
-                        http::string_request default_request;
-                        auto init_request = [&](const http::request_parser &parser) -> http::detail::base_request& {
-                            auto *request = static_cast<ProcessorT*>(srv)->prepare(parser, session);
-                            if (!request) {
-                                return default_request;
-                            }
-                            return *request;
-                        };
-                        while (true) {
-                            try {
-                                // wait next connection request
-                                auto req = co_await conn.next(init_request);
-                                if (!req)
-                                    break; // connection closed
-                                // process and send the response
-                                co_await conn.send(co_await static_cast<ProcessorT*>(srv)->process(*req));
-                            } catch (std::system_error &err) {
-                                if (err.code() == std::errc::connection_reset) {
-                                    break; // connection reset by peer
-                                } else {
-                                    throw err;
-                                }
-                            } catch (operation_cancelled &) {
-                                break;
-                            }
+                    if (limits_.overload == admission_limits::policy::pause) {
+                        while (limits_.max_connections and stats_.connections >= limits_.max_connections
+                               and not cs_.is_cancellation_requested()) {
+                            ++stats_.paused_accepts;
+                            co_await connection_released_;
                         }
-                    }(this, std::move(conn)));
+                    }
+                    auto conn = co_await listen();
+                    metrics::local().accepted_connections.add();
+                    if (not acquire_peer(conn)) {
+                        ++stats_.rejected_peer_connections;
+                        scope.spawn(reject(std::move(conn)));
+                    } else if (not acquire(stats_.connections, limits_.max_connections)) {
+                        ++stats_.rejected_connections;
+                        release_peer(conn);
+                        scope.spawn(reject(std::move(conn)));
+                    } else {
+                        scope.spawn(handle(std::move(conn)));
+                    }
                 }
             } catch (operation_cancelled &) {}
             co_await scope.join();
         }
+
+    protected:
+        void on_stop() override {
+            // wake up paused accept and requests
+            connection_released_.set();
+            request_released_.set();
+        }
+
+    private:
+        static bool acquire(std::atomic<size_t> &count, size_t max) noexcept {
+            auto current = count.load(std::memory_order_relaxed);
+            do {
+                if (max and current >= max) {
+                    return false;
+                }
+            } while (not count.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+            return true;
+        }
+
+        bool acquire_peer(const connection_type &conn) {
+            if (not limits_.max_connections_per_peer) {
+                return true;
+            }
+            std::scoped_lock lock{peers_mutex_};
+            auto &count = peers_[conn.peer_address().address()];
+            if (count >= limits_.max_connections_per_peer) {
+                return false;
+            }
+            ++count;
+            return true;
+        }
+
+        void release_peer(const connection_type &conn) {
+            if (not limits_.max_connections_per_peer) {
+                return;
+            }
+            std::scoped_lock lock{peers_mutex_};
+            if (auto it = peers_.find(conn.peer_address().address()); it != peers_.end() and --it->second == 0) {
+                peers_.erase(it);
+            }
+        }
+
+        /**
+         * @brief Answer 503, the connection is to be closed.
+         */
+        static tcp::connection_task<> send_unavailable(connection_type &conn) {
+            try {
+                string_response response{http::status::HTTP_STATUS_SERVICE_UNAVAILABLE, "", {{"Connection", "close"}}};
+                co_await conn.send(response);
+                co_await conn.flush(); // pipelined responses queued before this one
+            } catch (std::system_error &) {
+            } catch (operation_cancelled &) {}
+        }
+
+        /**
+         * @brief Answer 503 with a Retry-After header, the connection stays open.
+         */
+        static tcp::connection_task<> send_retry_later(connection_type &conn, std::chrono::seconds retry_after) {
+            std::array<char, 24> seconds;
+            auto end = std::to_chars(seconds.begin(), seconds.end(), retry_after.count()).ptr;
+            string_response response{http::status::HTTP_STATUS_SERVICE_UNAVAILABLE, "",
+                                     {{"Retry-After", {seconds.data(), size_t(end - seconds.data())}}}};
+            co_await conn.send(response);
+        }
+
+        static task<> reject(connection_type conn) {
+            co_await send_unavailable(conn);
+        }
+
+        task<> handle(connection_type conn) {
+            metrics::local().active_connections.add();
+            auto _ = on_scope_exit([&] {
+                release_peer(conn);
+                --stats_.connections;
+                connection_released_.set();
+                metrics::local().active_connections.sub();
+            });
+            session_type session{};
+            http::string_request default_request;
+            auto *processor = static_cast<ProcessorT *>(this);
+            auto init_request = [&](const http::request_parser &parser) -> http::detail::base_request & {
+                auto *request = processor->prepare(parser, session);
+                if (!request) {
+                    return default_request;
+                }
+                return *request;
+            };
+            while (true) {
+                try {
+                    // wait next connection request
+                    auto req = co_await conn.next(init_request);
+                    if (!req)
+                        break; // connection closed
+                    metrics::local().requests.add();
+                    if (not acquire(stats_.requests, limits_.max_requests)) {
+                        if (limits_.overload == admission_limits::policy::reject) {
+                            ++stats_.rejected_requests;
+                            co_await send_unavailable(conn);
+                            break;
+                        }
+                        co_await wait_request();
+                    }
+                    metrics::local().active_requests.add();
+                    auto release_request = on_scope_exit([&] {
+                        --stats_.requests;
+                        request_released_.set();
+                        metrics::local().active_requests.sub();
+                    });
+                    if (limits_.queue_delay_target.count()) {
+                        // let the requests queued before this one go first
+                        co_await service().schedule();
+                        if (codel_.drop(std::chrono::steady_clock::now() - conn.received_at(),
+                                        limits_.queue_delay_target, limits_.queue_delay_interval)) {
+                            ++stats_.shed_requests;
+                            co_await send_retry_later(conn, limits_.retry_after);
+                            continue;
+                        }
+                    }
+                    // process and send the response
+                    const auto send_time = conn.send_time();
+                    const auto process_start = std::chrono::steady_clock::now();
+                    if constexpr (detail::session_processor<ProcessorT, session_type>) {
+                        co_await processor->process(*req, conn, session);
+                    } else {
+                        co_await processor->process(*req, conn);
+                    }
+                    metrics::local().handler_latency.record(std::chrono::steady_clock::now() - process_start
+                                                            - (conn.send_time() - send_time));
+                } catch (std::system_error &err) {
+                    if (tcp::connection_lost(err)) {
+                        break; // connection reset or closed by peer, or response cut short
+                    } else {
+                        throw err;
+                    }
+                } catch (operation_cancelled &) {
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Wait for an in-flight request slot.
+         */
+        task<> wait_request() {
+            ++stats_.paused_requests;
+            do {
+                co_await request_released_;
+                if (cs_.is_cancellation_requested()) {
+                    request_released_.set(); // stopped: wake up the next waiter too
+                    throw operation_cancelled{};
+                }
+            } while (not acquire(stats_.requests, limits_.max_requests));
+            if (stats_.requests < limits_.max_requests) {
+                request_released_.set(); // more slots are free: wake up the next waiter
+            }
+        }
+
+        admission_limits limits_;
+        admission_stats stats_;
+        detail::codel codel_;
+        async_auto_reset_event connection_released_;
+        async_auto_reset_event request_released_;
+        std::mutex peers_mutex_;
+        std::map<net::ip_address, size_t> peers_;
     };
 }
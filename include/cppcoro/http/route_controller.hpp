@@ -7,13 +7,19 @@
 #include <cppcoro/http/http_response.hpp>
 #include <cppcoro/http/http_request.hpp>
 #include <cppcoro/http/details/router.hpp>
+#include <cppcoro/http/details/prefix_router.hpp>
 #include <cppcoro/http/request_processor.hpp>
+#include <cppcoro/http/metrics.hpp>
 
 #include <cppcoro/task.hpp>
 
 #include <ctll.hpp>
 #include <ctre.hpp>
 
+#include <algorithm>
+#include <array>
+#include <variant>
+
 namespace cppcoro::http {
 
     namespace detail {
@@ -38,19 +44,63 @@ namespace cppcoro::http {
             &ControllerT::init_request;
         };
 
+        /**
+         * @brief UTF-8 copy of @a route.
+         */
+        template<ctll::fixed_string route>
+        constexpr auto make_route_pattern() {
+            struct pattern_type
+            {
+                std::array<char, route.size() * 4 + 1> data{};
+                size_t size = 0;
+
+                [[nodiscard]] constexpr std::string_view view() const {
+                    return {data.data(), size};
+                }
+            } pattern;
+            for (size_t ii = 0; ii < route.size(); ++ii) {
+                const auto c = uint32_t(route[ii]);
+                if (c < 0x80) {
+                    pattern.data[pattern.size++] = char(c);
+                } else if (c < 0x800) {
+                    pattern.data[pattern.size++] = char(0xC0 | (c >> 6));
+                    pattern.data[pattern.size++] = char(0x80 | (c & 0x3F));
+                } else if (c < 0x10000) {
+                    pattern.data[pattern.size++] = char(0xE0 | (c >> 12));
+                    pattern.data[pattern.size++] = char(0x80 | ((c >> 6) & 0x3F));
+                    pattern.data[pattern.size++] = char(0x80 | (c & 0x3F));
+                } else {
+                    pattern.data[pattern.size++] = char(0xF0 | (c >> 18));
+                    pattern.data[pattern.size++] = char(0x80 | ((c >> 12) & 0x3F));
+                    pattern.data[pattern.size++] = char(0x80 | ((c >> 6) & 0x3F));
+                    pattern.data[pattern.size++] = char(0x80 | (c & 0x3F));
+                }
+            }
+            return pattern;
+        }
+
         struct abstract_route_controller
         {
             explicit abstract_route_controller(io_service &service) noexcept : service_{service} {}
-            virtual ~abstract_route_controller() = default;
-
-            virtual task<detail::base_response&> process() = 0;
-            virtual http::detail::base_request *_init_request(std::string_view url) = 0;
-            virtual bool match(std::string_view url) = 0;
 
             io_service &service_;
             void *session_ = nullptr;
         };
 
+        /**
+         * @brief Per-connection state of a controller_server.
+         *
+         * Holds the user session and the controller handling the current request: controllers are instantiated
+         * per connection, so concurrent connections never share routing results, requests or responses.
+         */
+        template<typename SessionT, typename...ControllersT>
+        struct controller_context
+        {
+            SessionT session{};
+            std::variant<std::monostate, ControllersT...> controller;
+            bool routed = false;
+        };
+
     }
 
     namespace detail {
@@ -80,69 +130,51 @@ namespace cppcoro::http {
             return static_cast<Derived&>(*this);
         }
 
-        using handler_type = std::function<cppcoro::task<detail::base_response&>(route_controller&)>;
-        std::map<http::method, handler_type> handlers_;
-        http::string_response error_response_;
+        using handler_type = tcp::connection_task<> (*)(route_controller&, server::connection_type&);
 
-
-        template<http::method method, typename HandlerT>
-        void register_handler(HandlerT &&handler) {
-            using traits = detail::function_traits<HandlerT>;
+        template<auto handler>
+        static tcp::connection_task<> call_handler(route_controller &self, server::connection_type &connection) {
             using handler_trait = detail::view_handler_traits<cppcoro::task<detail::base_response>,
                 detail::function_detail::parameters_tuple_all_enabled,
-                HandlerT>;
+                decltype(handler)>;
             using response_type = typename handler_trait::await_result_type;
-            std::shared_ptr<response_type> response;
-            constexpr auto has_response_body = detail::has_body_type<response_type>;
-            if constexpr (has_response_body) {
-                if constexpr (std::constructible_from<typename response_type::body_type, io_service&>) {
-                    response = std::make_shared<response_type>(
-                        http::status::HTTP_STATUS_INTERNAL_SERVER_ERROR,
-                        typename response_type::body_type{service_});
-                } else {
-                    response = std::make_shared<response_type>();
-                }
+            typename handler_trait::data_type data;
+            handler_trait::load_data(self.match_result_, data);
+            // the response keeps its concrete type down to the connection
+            response_type response = co_await std::apply(handler, std::tuple_cat(std::make_tuple(&self.self()), data));
+            if constexpr (detail::is_visitable<response_type>) {
+                co_await std::visit([&connection](auto &elem) {
+                    return connection.send(elem);
+                }, response);
             } else {
-                response = std::make_shared<response_type>();
+                co_await connection.send(response);
             }
-            handlers_[method] = [data = std::make_shared<typename handler_trait::data_type>(),
-                                 response = response,
-                                 handler = std::forward<HandlerT>(handler)]
-                (route_controller &self) mutable -> cppcoro::task<detail::base_response&> {
-                handler_trait::load_data(self.match_result_, *data);
-                *response = co_await std::apply(handler, std::tuple_cat(std::make_tuple(&self.self()), *data));
-                if constexpr (detail::is_visitable<response_type>) {
-                    detail::base_response *ptr = nullptr;
-                    std::visit([&ptr](auto &elem) mutable {
-                        ptr = &elem;
-                    }, *response);
-                    co_return *ptr;
-                } else {
-                    co_return *response;
-                }
-            };
-        };
+        }
 
-        bool match(std::string_view url) final {
-            match_result_ = std::move(match_(url));
-            return bool(match_result_);
+        static tcp::connection_task<> method_not_allowed(route_controller &, server::connection_type &connection) {
+            string_response response{http::status::HTTP_STATUS_METHOD_NOT_ALLOWED};
+            co_await connection.send(response);
         }
 
-        http::detail::base_request *_init_request(std::string_view url) final {
-            request_.emplace(make_request());
-            request_->path = url;
-            assert(match(request_->path)); // reload results
-            if constexpr (detail::has_init_request_handler<Derived>) {
-                using traits = detail::function_traits<decltype(&Derived::init_request)>;
-                using data_type = typename traits::template parameters_tuple<detail::function_detail::parameters_tuple_disable<request_type>>::tuple_type;
-                data_type data;
-                detail::load_data(match_result_, data);
-                std::apply(&Derived::init_request, std::tuple_cat(
-                    std::make_tuple(static_cast<Derived *>(this)),
-                    data,
-                    std::tuple<request_type&>(*request_)));
+        /**
+         * @brief Handlers indexed by http::method, methods without on_<method> fall through to method_not_allowed.
+         */
+        static constexpr auto make_handlers() {
+            std::array<handler_type, size_t(http::method::unknown) + 1> handlers{};
+            handlers.fill(&method_not_allowed);
+#define __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(__method) \
+            if constexpr (detail::is_ ## __method ## _controller<Derived>) { \
+                handlers[size_t(http::method:: __method)] = &call_handler<&Derived::on_ ## __method>;\
             }
-            return &*request_;
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(post)
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(get)
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(put)
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(del)
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(head)
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(options)
+            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(patch)
+#undef __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL
+            return handlers;
         }
 
         auto make_request() {
@@ -161,78 +193,152 @@ namespace cppcoro::http {
         auto &session() { return *static_cast<SessionT*>(session_); }
         auto &service() { return service_; }
 
+        static constexpr auto route_prefix_ = detail::make_route_prefix<route>();
+        static constexpr auto route_pattern_ = detail::make_route_pattern<route>();
+
     public:
+        /**
+         * @brief Literal part every url matched by this controller starts with.
+         */
+        static constexpr std::string_view route_prefix = route_prefix_.view();
+
+        /**
+         * @brief The route regex, labels this controller's metrics.
+         */
+        static constexpr std::string_view route_pattern = route_pattern_.view();
+
         route_controller(const route_controller&) = delete;
         route_controller& operator=(const route_controller&) = delete;
-        route_controller(route_controller &&other) = default;
-        route_controller& operator=(route_controller &&other) noexcept = default;
 
         explicit route_controller(io_service &service)
             : detail::abstract_route_controller{service} {
+        }
 
-#define __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(__method) \
-            if constexpr (detail::is_ ## __method ## _controller<Derived>) { \
-                register_handler<http::method:: __method>(&Derived::on_ ## __method);\
-            }
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(post)
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(get)
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(put)
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(del)
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(head)
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(options)
-            __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL(patch)
-#undef __CPPCORO_HTTP_MAKE_METHOD_CHECKER_IMPL
+        static bool match(std::string_view url) {
+            return bool(match_(url));
         }
 
-        task<detail::base_response&> process() override {
-            if (handlers_.contains(request_->method)) {
-                auto &result = co_await handlers_.at(request_->method)(*this);
-                co_return result;
+        /**
+         * @brief Get ready to handle a request on @a url.
+         *
+         * @return nullptr when @a url does not match the route.
+         */
+        http::detail::base_request *_init_request(std::string_view url) {
+            if constexpr (requires(request_type &request) { request.clear(); }) {
+                // reuse the previous request storage
+                if (request_) {
+                    request_->clear();
+                } else {
+                    request_.emplace(make_request());
+                }
+            } else {
+                request_.emplace(make_request());
             }
-            error_response_.status = http::status::HTTP_STATUS_METHOD_NOT_ALLOWED;
-            co_return error_response_;
+            request_->path = url;
+            match_result_ = match_(request_->path); // captures refer to our own copy of the url
+            if (not match_result_) {
+                return nullptr;
+            }
+            if constexpr (detail::has_init_request_handler<Derived>) {
+                using traits = detail::function_traits<decltype(&Derived::init_request)>;
+                using data_type = typename traits::template parameters_tuple<detail::function_detail::parameters_tuple_disable<request_type>>::tuple_type;
+                data_type data;
+                detail::load_data(match_result_, data);
+                std::apply(&Derived::init_request, std::tuple_cat(
+                    std::make_tuple(static_cast<Derived *>(this)),
+                    data,
+                    std::tuple<request_type&>(*request_)));
+            }
+            return &*request_;
+        }
+
+        /**
+         * @brief Process the current request and send the response over @a connection.
+         */
+        tcp::connection_task<> process(server::connection_type &connection) {
+            // built on first use, once Derived is complete
+            static constexpr auto handlers = make_handlers();
+            const auto index = std::min(size_t(request_->method), handlers.size() - 1);
+            return handlers[index](*this, connection);
         }
     };
 
     template<typename SessionType, typename...ControllersT>
-    struct controller_server : http::request_processor<SessionType, controller_server<SessionType, ControllersT...>>
+    struct controller_server : http::request_processor<detail::controller_context<SessionType, ControllersT...>,
+                                                       controller_server<SessionType, ControllersT...>>
     {
-        using processor_type = http::request_processor<SessionType, controller_server<SessionType, ControllersT...>>;
+        using context_type = detail::controller_context<SessionType, ControllersT...>;
+        using processor_type = http::request_processor<context_type, controller_server<SessionType, ControllersT...>>;
         using session_type = SessionType;
 
-        controller_server(io_service &service, const net::ip_endpoint &endpoint) noexcept
-            : processor_type{service, endpoint}
-            , controllers_{std::make_unique<ControllersT>(ControllersT{this->ios_})...}
+        controller_server(io_service &service, const net::ip_endpoint &endpoint, bool reuse_port = false)
+            : processor_type{service, endpoint, reuse_port}
         {
         }
 
-        http::detail::base_request *prepare(const http::request_parser &parser, session_type &session) {
-            next_proc_ = nullptr;
-            for (auto &controller : controllers_) {
-                if (controller->match(parser.url())) {
-                    controller->session_ = &session;
-                    next_proc_ = controller.get();
-                    return controller->_init_request(parser.url());
-                }
-            }
-            return nullptr;
+        http::detail::base_request *prepare(const http::request_parser &parser, context_type &context) {
+            http::detail::base_request *request = nullptr;
+            // only controllers which route prefix matches get their regex evaluated
+            router_.visit(parser.url(), [&](size_t index) {
+                request = preparers_[index](*this, context, parser.url());
+                return request != nullptr;
+            });
+            context.routed = request != nullptr;
+            return request;
         }
 
-        cppcoro::task<http::detail::base_response&> process(http::detail::base_request &request) {
-            if (!next_proc_) {
-                error_response_ = string_response{
-                    http::status::HTTP_STATUS_NOT_FOUND,
-                };
-                co_return error_response_;
-            } else {
-                http::detail::base_response &response = co_await next_proc_->process();
-                co_return response;
+        /**
+         * @brief Dispatch to the controller prepared for the request: no coroutine frame of its own.
+         */
+        tcp::connection_task<> process(http::detail::base_request &, server::connection_type &connection, context_type &context) {
+            if (not context.routed) {
+                metrics::local().route(unmatched_route_id_);
+                return not_found(connection);
             }
+            const auto index = context.controller.index() - 1;
+            metrics::local().route(route_ids_[index]);
+            return dispatchers_[index](context, connection);
         }
 
     private:
-        string_response error_response_;
-        detail::abstract_route_controller *next_proc_;
-        std::array<std::unique_ptr<detail::abstract_route_controller>, sizeof...(ControllersT)> controllers_;
+        static tcp::connection_task<> not_found(server::connection_type &connection) {
+            string_response response{http::status::HTTP_STATUS_NOT_FOUND};
+            co_await connection.send(response);
+        }
+
+        template<typename ControllerT>
+        static tcp::connection_task<> dispatch_controller(context_type &context, server::connection_type &connection) {
+            return std::get<ControllerT>(context.controller).process(connection);
+        }
+
+        template<typename ControllerT>
+        static http::detail::base_request *prepare_controller(controller_server &self, context_type &context,
+                                                             std::string_view url) {
+            // candidates sharing a prefix are tested on the url first: a miss neither constructs a controller
+            // nor replaces the connection's current one
+            if (not ControllerT::match(url)) {
+                return nullptr;
+            }
+            // the connection keeps its controller from one request to the next
+            auto *controller = std::get_if<ControllerT>(&context.controller);
+            if (not controller) {
+                controller = &context.controller.template emplace<ControllerT>(self.ios_);
+            }
+            controller->session_ = &context.session;
+            return controller->_init_request(url);
+        }
+
+        using preparer_type = http::detail::base_request *(*)(controller_server &, context_type &, std::string_view);
+        static constexpr std::array<preparer_type, sizeof...(ControllersT)> preparers_{&prepare_controller<ControllersT>...};
+
+        using dispatcher_type = tcp::connection_task<> (*)(context_type &, server::connection_type &);
+        static constexpr std::array<dispatcher_type, sizeof...(ControllersT)> dispatchers_{&dispatch_controller<ControllersT>...};
+
+        const size_t unmatched_route_id_ = metrics::global().route(metrics::unmatched_route);
+        const std::array<size_t, sizeof...(ControllersT)> route_ids_{
+            metrics::global().route(ControllersT::route_pattern)...};
+
+        static constexpr auto router_ = detail::make_prefix_trie<1 + (ControllersT::route_prefix.size() + ...)>(
+            std::array<std::string_view, sizeof...(ControllersT)>{ControllersT::route_prefix...});
     };
 }
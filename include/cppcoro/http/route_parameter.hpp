@@ -37,7 +37,7 @@ namespace cppcoro::http {
     struct route_parameter<std::filesystem::path> {
         static constexpr int group_count() { return 0; }
         static std::filesystem::path load(const std::string_view& input) {
-            return {input.data()};
+            return {input.begin(), input.end()};
         }
         static constexpr auto pattern = ctll::fixed_string{R"(.+)"};
     };
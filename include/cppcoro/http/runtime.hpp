@@ -0,0 +1,137 @@
+/**
+ * @file cppcoro/http/runtime.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cppcoro/task.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <concepts>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace cppcoro::http {
+
+    /**
+     * @brief Thread-per-core runtime.
+     *
+     * Owns N io_service shards, each one driven by a single dedicated thread (optionally pinned to a cpu).
+     * Coroutines started on a shard never resume on another one, so shards share nothing.
+     */
+    class runtime
+    {
+    public:
+        explicit runtime(size_t shard_count = std::thread::hardware_concurrency(), bool pin_threads = false)
+            : pin_threads_{pin_threads} {
+            shard_count = std::max<size_t>(shard_count, 1);
+            services_.reserve(shard_count);
+            for (size_t ii = 0; ii < shard_count; ++ii) {
+                services_.emplace_back(std::make_unique<io_service>());
+            }
+        }
+
+        runtime(const runtime &) = delete;
+        runtime &operator=(const runtime &) = delete;
+
+        [[nodiscard]] size_t size() const noexcept {
+            return services_.size();
+        }
+
+        auto &service(size_t index) noexcept {
+            return *services_.at(index);
+        }
+
+        /**
+         * @brief Run @a fn on every shard.
+         *
+         * @a fn is invoked with the shard's io_service and index from the shard thread and must return a task<>.
+         * A shard stops processing events once its task completes, run blocks until all shards are done.
+         * An error escaping a shard is rethrown from here once all shards are done: @a fn is expected to
+         * stop the other shards on failure (ie.: sharded_server stops all its servers).
+         */
+        template<typename FnT>
+        requires std::invocable<FnT &, io_service &, size_t>
+        void run(FnT &&fn) {
+            std::vector<std::thread> threads;
+            std::vector<std::exception_ptr> errors(services_.size());
+            threads.reserve(services_.size());
+            for (size_t index = 0; index < services_.size(); ++index) {
+                threads.emplace_back([this, index, &fn, &errors] {
+                    if (pin_threads_) {
+                        pin(index);
+                    }
+                    auto &service = *services_[index];
+                    service.reset();
+                    try {
+                        (void) sync_wait(when_all(
+                            [&]() -> task<> {
+                                auto _ = on_scope_exit([&] {
+                                    service.stop();
+                                });
+                                co_await fn(service, index);
+                            }(),
+                            [&]() -> task<> {
+                                service.process_events();
+                                co_return;
+                            }()));
+                    } catch (...) {
+                        errors[index] = std::current_exception();
+                    }
+                });
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            for (auto &error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+
+        void stop() noexcept {
+            for (auto &service : services_) {
+                service->stop();
+            }
+        }
+
+    private:
+        /**
+         * Pin the calling thread to the index-th cpu this process is allowed to run on.
+         */
+        static void pin(size_t index) {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 or CPU_COUNT(&allowed) == 0) {
+                return;
+            }
+            auto nth = index % size_t(CPU_COUNT(&allowed));
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &allowed) and nth-- == 0) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpu, &set);
+                    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                        spdlog::warn("unable to pin shard {} on cpu {}", index, cpu);
+                    }
+                    return;
+                }
+            }
+        }
+
+        bool pin_threads_;
+        std::vector<std::unique_ptr<io_service>> services_;
+    };
+}
@@ -0,0 +1,105 @@
+/**
+ * @file cppcoro/http/sharded_server.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/http/runtime.hpp>
+#include <cppcoro/net/ip_endpoint.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+#include <cppcoro/task.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cppcoro::http {
+
+    /**
+     * @brief Sharded server.
+     *
+     * Runs one independent @a ServerT instance per runtime shard, all listening on the same endpoint (SO_REUSEPORT).
+     * Each instance is created on its own shard thread, so every shard has its own listener, controller set
+     * and sessions: the kernel spreads incoming connections across the listeners and a connection never leaves
+     * the shard that accepted it.
+     *
+     * @tparam ServerT A request processor (ie.: controller_server) constructible
+     *         from (io_service &, const net::ip_endpoint &, bool reuse_port, ArgsT &...).
+     *
+     * Extra constructor @a args are passed by reference to every instance (ie.: a shared dynamic_router).
+     */
+    template<typename ServerT>
+    class sharded_server
+    {
+    public:
+        template<typename...ArgsT>
+        sharded_server(http::runtime &runtime, const net::ip_endpoint &endpoint, ArgsT &...args)
+            : runtime_{runtime}, endpoint_{endpoint}
+            , make_server_{[...args = std::ref(args)](io_service &service, const net::ip_endpoint &endpoint) {
+                return std::make_unique<ServerT>(service, endpoint, true, args.get()...);
+            }} {}
+
+        sharded_server(const sharded_server &) = delete;
+        sharded_server &operator=(const sharded_server &) = delete;
+
+        /**
+         * @brief Serve on all shards.
+         *
+         * Blocks until every shard is stopped. When a shard fails (ie.: its server cannot be created),
+         * all shards are stopped and the error is rethrown.
+         */
+        void serve() {
+            runtime_.run([this](io_service &service, size_t) -> task<> {
+                try {
+                    auto server = make_server_(service, endpoint_);
+                    if (not attach(*server)) {
+                        co_return;
+                    }
+                    auto _ = on_scope_exit([&] {
+                        detach(*server);
+                    });
+                    co_await server->serve();
+                } catch (...) {
+                    stop(); // ie.: the endpoint could not be bound, no shard serves
+                    throw;
+                }
+            });
+        }
+
+        void stop() {
+            std::scoped_lock lock{mutex_};
+            stopped_ = true;
+            for (auto *server : servers_) {
+                server->stop();
+            }
+        }
+
+        [[nodiscard]] size_t size() const noexcept {
+            return runtime_.size();
+        }
+
+    private:
+        bool attach(ServerT &server) {
+            std::scoped_lock lock{mutex_};
+            if (stopped_) {
+                return false;
+            }
+            servers_.push_back(&server);
+            return true;
+        }
+
+        void detach(ServerT &server) {
+            std::scoped_lock lock{mutex_};
+            servers_.erase(std::remove(begin(servers_), end(servers_), &server), end(servers_));
+        }
+
+        http::runtime &runtime_;
+        net::ip_endpoint endpoint_;
+        std::function<std::unique_ptr<ServerT>(io_service &, const net::ip_endpoint &)> make_server_;
+        std::mutex mutex_;
+        bool stopped_ = false;
+        std::vector<ServerT *> servers_;
+    };
+}
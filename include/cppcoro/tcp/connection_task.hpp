@@ -0,0 +1,264 @@
+/**
+ * @file cppcoro/tcp/connection_task.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <cppcoro/broken_promise.hpp>
+#include <cppcoro/details/arena.hpp>
+
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace cppcoro::tcp {
+    class connection;
+
+    template<typename T = void>
+    class connection_task;
+
+    namespace detail {
+        template<typename T>
+        concept connection_reference = std::is_lvalue_reference_v<T>
+                                       and std::derived_from<std::remove_cvref_t<T>, tcp::connection>;
+
+        template<typename...ArgsT>
+        constexpr size_t connection_parameter_index() {
+            constexpr bool matches[] = {connection_reference<ArgsT>..., false};
+            size_t index = 0;
+            while (index < sizeof...(ArgsT) and not matches[index]) {
+                ++index;
+            }
+            return index;
+        }
+
+        /**
+         * @brief Coroutine frames allocated from a connection's arena.
+         *
+         * The arena is recorded in front of the frame, so it can be released without the connection.
+         */
+        struct arena_frame
+        {
+            static constexpr size_t header_size = alignof(std::max_align_t);
+
+            static void *allocate(cppcoro::detail::arena &arena, size_t size) {
+                auto *header = static_cast<std::byte *>(arena.allocate(size + header_size, header_size));
+                *reinterpret_cast<cppcoro::detail::arena **>(header) = &arena;
+                return header + header_size;
+            }
+
+            static void deallocate(void *frame, size_t size) noexcept {
+                auto *header = static_cast<std::byte *>(frame) - header_size;
+                auto *arena = *reinterpret_cast<cppcoro::detail::arena **>(header);
+                arena->deallocate(header, size + header_size, header_size);
+            }
+        };
+
+        class connection_task_promise_base
+        {
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept { return false; }
+
+                template<typename PromiseT>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<PromiseT> coroutine) noexcept {
+                    return coroutine.promise().continuation_;
+                }
+
+                void await_resume() noexcept {}
+            };
+
+        public:
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            final_awaiter final_suspend() noexcept { return {}; }
+
+            void set_continuation(std::coroutine_handle<> continuation) noexcept {
+                continuation_ = continuation;
+            }
+
+        private:
+            std::coroutine_handle<> continuation_;
+        };
+
+        template<typename T>
+        class connection_task_promise : public connection_task_promise_base
+        {
+        public:
+            void unhandled_exception() noexcept {
+                result_.template emplace<2>(std::current_exception());
+            }
+
+            template<typename ValueT>
+            requires std::convertible_to<ValueT &&, T>
+            void return_value(ValueT &&value) noexcept(std::is_nothrow_constructible_v<T, ValueT &&>) {
+                result_.template emplace<1>(std::forward<ValueT>(value));
+            }
+
+            T &result() & {
+                rethrow_if_exception();
+                return std::get<1>(result_);
+            }
+
+            T &&result() && {
+                rethrow_if_exception();
+                return std::move(std::get<1>(result_));
+            }
+
+        private:
+            void rethrow_if_exception() {
+                if (result_.index() == 2) {
+                    std::rethrow_exception(std::get<2>(result_));
+                }
+            }
+
+            std::variant<std::monostate, T, std::exception_ptr> result_;
+        };
+
+        template<>
+        class connection_task_promise<void> : public connection_task_promise_base
+        {
+        public:
+            void unhandled_exception() noexcept {
+                exception_ = std::current_exception();
+            }
+
+            void return_void() noexcept {}
+
+            void result() {
+                if (exception_) {
+                    std::rethrow_exception(exception_);
+                }
+            }
+
+        private:
+            std::exception_ptr exception_;
+        };
+
+        /**
+         * @brief Promise of a connection_task coroutine taking @a ArgsT.
+         *
+         * The frame comes from the arena of the first parameter that is a connection reference
+         * (the implicit object parameter of member coroutines).
+         */
+        template<typename T, typename...ArgsT>
+        class connection_task_frame final : public connection_task_promise<T>
+        {
+            static constexpr auto connection_index = connection_parameter_index<ArgsT...>();
+            static_assert(connection_index < sizeof...(ArgsT),
+                          "connection_task coroutines must take a tcp::connection by reference");
+
+        public:
+            static void *operator new(size_t size, std::add_lvalue_reference_t<ArgsT>...args) {
+                auto &connection = std::get<connection_index>(std::forward_as_tuple(args...));
+                return arena_frame::allocate(connection.arena(), size);
+            }
+
+            static void operator delete(void *frame, size_t size) noexcept {
+                arena_frame::deallocate(frame, size);
+            }
+
+            connection_task<T> get_return_object() noexcept {
+                return connection_task<T>{std::coroutine_handle<connection_task_frame>::from_promise(*this), *this};
+            }
+        };
+    }
+
+    /**
+     * @brief Lazy task which frame is allocated from the arena of the connection it works on.
+     *
+     * Used by the coroutines making up a connection's request/response cycle, so that they do not hit
+     * the global allocator once the connection is warmed up. Every other coroutine (ie.: user handlers),
+     * even when taking a connection by reference, keeps using cppcoro::task and the global allocator.
+     */
+    template<typename T>
+    class [[nodiscard]] connection_task
+    {
+    public:
+        connection_task(std::coroutine_handle<> coroutine, detail::connection_task_promise<T> &promise) noexcept
+            : coroutine_{coroutine}, promise_{&promise} {}
+
+        connection_task(connection_task &&other) noexcept
+            : coroutine_{std::exchange(other.coroutine_, {})}, promise_{other.promise_} {}
+
+        connection_task(const connection_task &) = delete;
+
+        connection_task &operator=(const connection_task &) = delete;
+
+        connection_task &operator=(connection_task &&other) noexcept {
+            if (this != &other) {
+                if (coroutine_) {
+                    coroutine_.destroy();
+                }
+                coroutine_ = std::exchange(other.coroutine_, {});
+                promise_ = other.promise_;
+            }
+            return *this;
+        }
+
+        ~connection_task() {
+            if (coroutine_) {
+                coroutine_.destroy();
+            }
+        }
+
+        auto operator co_await() const & noexcept {
+            struct awaitable : awaitable_base
+            {
+                decltype(auto) await_resume() {
+                    if (not this->coroutine) {
+                        throw broken_promise{};
+                    }
+                    return this->promise->result();
+                }
+            };
+            return awaitable{{coroutine_, promise_}};
+        }
+
+        auto operator co_await() const && noexcept {
+            struct awaitable : awaitable_base
+            {
+                decltype(auto) await_resume() {
+                    if (not this->coroutine) {
+                        throw broken_promise{};
+                    }
+                    return std::move(*this->promise).result();
+                }
+            };
+            return awaitable{{coroutine_, promise_}};
+        }
+
+    private:
+        struct awaitable_base
+        {
+            std::coroutine_handle<> coroutine;
+            detail::connection_task_promise<T> *promise;
+
+            bool await_ready() const noexcept {
+                return not coroutine or coroutine.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                promise->set_continuation(awaiting);
+                return coroutine;
+            }
+        };
+
+        std::coroutine_handle<> coroutine_;
+        detail::connection_task_promise<T> *promise_ = nullptr;
+    };
+}
+
+/**
+ * @brief connection_task promises depend on the coroutine parameters, to allocate frames from the connection.
+ */
+template<typename T, typename...ArgsT>
+struct std::coroutine_traits<cppcoro::tcp::connection_task<T>, ArgsT...>
+{
+    using promise_type = cppcoro::tcp::detail::connection_task_frame<T, ArgsT...>;
+};
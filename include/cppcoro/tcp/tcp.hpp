@@ -4,16 +4,51 @@
 #pragma once
 
 #include <cppcoro/io_service.hpp>
+#include <cppcoro/task.hpp>
 #include <cppcoro/net/socket.hpp>
 #include <cppcoro/cancellation_source.hpp>
+#include <cppcoro/cancellation_registration.hpp>
+#include <cppcoro/operation_cancelled.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+#include <cppcoro/when_all.hpp>
+#include <cppcoro/async_manual_reset_event.hpp>
+#include <cppcoro/details/arena.hpp>
+#include <cppcoro/tcp/connection_task.hpp>
+#include <cppcoro/details/timer_wheel.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
 #include <utility>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 namespace cppcoro {
     namespace net {
+        /**
+         * @brief Create a tcp socket.
+         *
+         * When @a reuse_port is set, SO_REUSEPORT is enabled before binding so that several
+         * listeners can share the same endpoint (the kernel balances incoming connections between them).
+         */
         template<bool bind = true>
-        auto create_tcp_socket(io_service &ios, const ip_endpoint &endpoint) {
+        auto create_tcp_socket(io_service &ios, const ip_endpoint &endpoint, bool reuse_port = false) {
             auto sock = socket{endpoint.is_ipv4() ? socket::create_tcpv4(ios) : socket::create_tcpv6(ios)};
+            if (reuse_port) {
+                int enable = 1;
+                if (::setsockopt(sock.native_handle(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+                    throw std::system_error{errno, std::system_category(), "SO_REUSEPORT"};
+                }
+            }
             if constexpr (bind) {
                 sock.bind(endpoint);
             }
@@ -21,17 +56,107 @@ namespace cppcoro {
         }
     }
     namespace tcp {
+        /**
+         * @brief Server connection timeouts, a zero timeout disables the check.
+         *
+         * All disabled by default.
+         */
+        struct server_timeouts
+        {
+            using duration = std::chrono::milliseconds;
+
+            duration idle{}; ///< keep-alive: no incoming bytes between two messages
+            duration header{}; ///< receiving a message head, from its first byte
+            duration write{}; ///< peer not accepting outgoing bytes
+        };
+
+        /**
+         * @brief Whether @a error leaves the connection unusable: reset or closed by the peer, message cut short.
+         */
+        inline bool connection_lost(const std::system_error &error) noexcept {
+            return error.code() == std::errc::connection_reset or error.code() == std::errc::connection_aborted
+                   or error.code() == std::errc::broken_pipe;
+        }
+
         class connection
         {
         public:
             connection(connection &&other) noexcept
-                : sock_{std::move(other.sock_)}, ct_{std::move(other.ct_)} {}
+                : ios_{other.ios_}, sock_{std::move(other.sock_)}, ct_{std::move(other.ct_)},
+                  arena_{std::move(other.arena_)},
+                  watchdog_{std::move(other.watchdog_)} {}
 
             connection(const connection &) = delete;
 
-            connection(net::socket socket, cancellation_token ct)
-                : sock_{std::move(socket)},
-                  ct_{std::move(ct)} {
+            connection(io_service &ios, net::socket socket, cancellation_token ct,
+                       std::unique_ptr<cppcoro::detail::arena> arena = std::make_unique<cppcoro::detail::arena>())
+                : ios_{&ios},
+                  sock_{std::move(socket)},
+                  ct_{std::move(ct)},
+                  arena_{std::move(arena)} {
+            }
+
+            /**
+             * @brief Connection which pending operations are cancelled when a timeout elapses.
+             *
+             * Operations are cancelled on @a ct cancellation too.
+             */
+            connection(io_service &ios, net::socket socket, cancellation_token ct,
+                       cppcoro::detail::timer_wheel &timers, const server_timeouts &timeouts)
+                : ios_{&ios},
+                  sock_{std::move(socket)},
+                  arena_{std::make_unique<cppcoro::detail::arena>()},
+                  watchdog_{std::make_unique<watchdog>(std::move(ct), timers, timeouts)} {
+                ct_ = watchdog_->source.token();
+            }
+
+            /**
+             * @brief Timeouts of this connection.
+             */
+            [[nodiscard]] const server_timeouts &timeouts() const noexcept {
+                static constexpr server_timeouts disabled{{}, {}, {}};
+                return watchdog_ ? watchdog_->timeouts : disabled;
+            }
+
+            /**
+             * @brief Cancel pending operations if still waiting after @a timeout.
+             *
+             * Replaces the previous deadline, a zero @a timeout disarms it.
+             */
+            void expires_after(server_timeouts::duration timeout) {
+                if (not watchdog_) {
+                    return;
+                }
+                if (timeout.count()) {
+                    watchdog_->timers.arm(watchdog_->timer, timeout);
+                } else {
+                    watchdog_->timers.disarm(watchdog_->timer);
+                }
+            }
+
+            /**
+             * @brief Cancel pending operations if still waiting at @a deadline.
+             *
+             * Replaces the previous deadline, a default constructed @a deadline disarms it.
+             */
+            void expires_at(std::chrono::steady_clock::time_point deadline) {
+                if (not watchdog_) {
+                    return;
+                }
+                if (deadline != std::chrono::steady_clock::time_point{}) {
+                    watchdog_->timers.arm_at(watchdog_->timer, deadline);
+                } else {
+                    watchdog_->timers.disarm(watchdog_->timer);
+                }
+            }
+
+            /**
+             * @brief Memory of the coroutines working on this connection.
+             *
+             * Every connection_task working on this connection gets its frame from here.
+             */
+            [[nodiscard]] cppcoro::detail::arena &arena() const noexcept {
+                return *arena_;
             }
 
             [[nodiscard]] const net::ip_endpoint &peer_address() const {
@@ -40,43 +165,253 @@ namespace cppcoro {
 
             [[nodiscard]] const auto &socket() const { return sock_; }
 
+            /**
+             * @brief Whether the connection is still usable: not closed by the peer, nothing unexpected received.
+             */
+            [[nodiscard]] bool alive() const noexcept {
+                char byte;
+                auto res = ::recv(sock_.native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+                return res < 0 and (errno == EAGAIN or errno == EWOULDBLOCK);
+            }
+
+            /**
+             * @brief Shut both directions down: pending and next operations see the connection as closed.
+             */
+            void shutdown() noexcept {
+                ::shutdown(sock_.native_handle(), SHUT_RDWR);
+            }
+
+            /**
+             * @brief Gather-write all @a buffers.
+             *
+             * A single non-blocking sendmsg is attempted first, so that small messages go out in one syscall.
+             * Whatever the kernel did not accept is then completed with regular asynchronous sends.
+             */
+            connection_task<size_t> send_vectored(std::span<iovec> buffers, int flags = 0) {
+                msghdr msg{};
+                msg.msg_iov = buffers.data();
+                msg.msg_iovlen = buffers.size();
+                size_t sent = 0;
+                if (auto res = ::sendmsg(sock_.native_handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL | flags); res > 0) {
+                    sent = size_t(res);
+                } else if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    throw std::system_error{errno, std::system_category()};
+                }
+                auto skip = sent;
+                for (auto &buffer : buffers) {
+                    if (skip >= buffer.iov_len) {
+                        skip -= buffer.iov_len;
+                        continue;
+                    }
+                    auto *data = static_cast<const char *>(buffer.iov_base) + skip;
+                    auto size = buffer.iov_len - skip;
+                    skip = 0;
+                    while (size) {
+                        expires_after(timeouts().write);
+                        auto res = co_await sock_.send(data, size, ct_);
+                        expires_after({});
+                        if (res == 0) {
+                            co_return sent;
+                        }
+                        data += res;
+                        size -= res;
+                        sent += res;
+                    }
+                }
+                co_return sent;
+            }
+
+            /**
+             * @brief Zero-copy transfer of @a count bytes of @a fd.
+             *
+             * Data goes from the page cache to the socket with sendfile. The socket is non-blocking for the duration
+             * of the transfer, so that a full send buffer never blocks the io thread: when the kernel cannot take
+             * more data, the socket is polled for writability (backing off on the io_service timers) and sendfile
+             * is retried. Returns less than @a count when the file is truncated.
+             */
+            connection_task<size_t> send_file(int fd, size_t count) {
+                const auto socket_fd = sock_.native_handle();
+                const auto flags = ::fcntl(socket_fd, F_GETFL);
+                if (flags < 0 or (not (flags & O_NONBLOCK) and ::fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+                    throw std::system_error{errno, std::system_category(), "O_NONBLOCK"};
+                }
+                auto restore_flags = on_scope_exit([&] {
+                    if (not (flags & O_NONBLOCK)) {
+                        ::fcntl(socket_fd, F_SETFL, flags);
+                    }
+                });
+                off_t offset = 0;
+                bool stalled = false;
+                while (size_t(offset) < count) {
+                    auto res = ::sendfile(socket_fd, fd, &offset, count - size_t(offset));
+                    if (res > 0) {
+                        if (std::exchange(stalled, false)) {
+                            expires_after({});
+                        }
+                        continue;
+                    } else if (res == 0) {
+                        break; // file truncated
+                    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        throw std::system_error{errno, std::system_category()};
+                    }
+                    if (not std::exchange(stalled, true)) {
+                        expires_after(timeouts().write); // the peer has that long to make room
+                    }
+                    co_await writable();
+                }
+                if (stalled) {
+                    expires_after({});
+                }
+                co_return size_t(offset);
+            }
+
         protected:
+            /**
+             * @brief Wait until the socket can take more data (or is in error).
+             *
+             * Sockets have no readiness awaitable: writability is polled, with a growing delay in between.
+             */
+            connection_task<> writable() {
+                static constexpr std::chrono::microseconds min_delay{250};
+                static constexpr std::chrono::microseconds max_delay{16'000};
+                pollfd pfd{sock_.native_handle(), POLLOUT, 0};
+                for (auto delay = min_delay; ::poll(&pfd, 1, 0) == 0; delay = std::min(delay * 2, max_delay)) {
+                    co_await ios_->schedule_after(delay, ct_);
+                }
+            }
+
+            struct watchdog
+            {
+                watchdog(cancellation_token parent, cppcoro::detail::timer_wheel &timers,
+                         const server_timeouts &timeouts)
+                    : timers{timers}, timeouts{timeouts},
+                      link{std::move(parent), [this] { source.request_cancellation(); }} {}
+
+                cppcoro::detail::timer_wheel &timers;
+                const server_timeouts timeouts;
+                cancellation_source source;
+                cancellation_registration link; // server stop
+                cppcoro::detail::timer_wheel::timer timer{source};
+            };
+
+            io_service *ios_;
             net::socket sock_;
             cancellation_token ct_;
+            std::unique_ptr<cppcoro::detail::arena> arena_; // stable address: frames refer to it
+            std::unique_ptr<watchdog> watchdog_; // stable address: the timer wheel refers to it
         };
 
         class server
         {
         public:
             server(server &&other) noexcept: ios_{other.ios_}, endpoint_{std::move(other.endpoint_)},
-                                             socket_{std::move(other.socket_)}, cs_{other.cs_} {}
+                                             socket_{std::move(other.socket_)}, cs_{other.cs_},
+                                             timers_{std::move(other.timers_)}, timeouts_{other.timeouts_} {}
 
             server(const server &) = delete;
 
-            server(io_service &ios, const net::ip_endpoint &endpoint)
-                : ios_{ios}, endpoint_{endpoint}, socket_{net::create_tcp_socket<true>(ios, endpoint_)} {
+            server(io_service &ios, const net::ip_endpoint &endpoint, bool reuse_port = false)
+                : ios_{ios}, endpoint_{endpoint}, socket_{net::create_tcp_socket<true>(ios, endpoint_, reuse_port)} {
                 socket_.listen();
             }
 
+            virtual ~server() = default;
+
             task<connection> accept() {
                 auto sock = net::create_tcp_socket<false>(ios_, endpoint_);
                 co_await socket_.accept(sock, cs_.token());
-                co_return connection{std::move(sock), cs_.token()};
+                co_return connection{ios_, std::move(sock), cs_.token(), *timers_, timeouts_};
             }
 
+            /**
+             * @brief Stop serving, callable from any thread.
+             *
+             * Pending operations are cancelled, then on_stop() runs on the server's io_service.
+             */
             void stop() {
                 cs_.request_cancellation();
             }
 
+            /**
+             * @brief Timeouts of the connections accepted from now on.
+             */
+            void timeouts(const server_timeouts &timeouts) noexcept {
+                timeouts_ = timeouts;
+            }
+
+            [[nodiscard]] const server_timeouts &timeouts() const noexcept {
+                return timeouts_;
+            }
+
+            /**
+             * @brief Background work of a serving server, completes once it is stopped.
+             *
+             * Drives the connection timeouts, and runs on_stop() once stopped.
+             */
+            task<> supervise() {
+                co_await when_all(run_timers(), wait_stopped());
+            }
+
             auto token() noexcept { return cs_.token(); }
 
             auto &service() noexcept { return ios_; }
 
+            /**
+             * @brief Endpoint the server listens on, ie.: the port picked by the system when bound to port 0.
+             */
+            [[nodiscard]] const net::ip_endpoint &local_endpoint() const noexcept {
+                return socket_.local_endpoint();
+            }
+
         protected:
+            /**
+             * @brief Called once stopped, on the server's io_service: releases what waits for the server.
+             */
+            virtual void on_stop() {}
+
             io_service &ios_;
             net::ip_endpoint endpoint_;
             net::socket socket_;
             cancellation_source cs_;
+            // one wheel for all the connections, stable address: they refer to it
+            std::unique_ptr<cppcoro::detail::timer_wheel> timers_ = std::make_unique<cppcoro::detail::timer_wheel>();
+            server_timeouts timeouts_;
+
+        private:
+            /**
+             * @brief Drive the connection timeouts until the server stops.
+             *
+             * Ticks only while timers are armed: with no timeout configured, the server never wakes up for them.
+             */
+            task<> run_timers() {
+                try {
+                    while (true) {
+                        while (timers_->size() == 0) {
+                            co_await timers_->armed();
+                            if (cs_.is_cancellation_requested()) {
+                                co_return;
+                            }
+                        }
+                        co_await ios_.schedule_after(timers_->resolution(), cs_.token());
+                        timers_->advance();
+                    }
+                } catch (operation_cancelled &) {}
+            }
+
+            /**
+             * @brief Wait for stop() and run on_stop().
+             */
+            task<> wait_stopped() {
+                async_manual_reset_event stopped;
+                cancellation_registration on_cancellation{cs_.token(), [&stopped] {
+                    stopped.set();
+                }};
+                co_await stopped;
+                // stop() may be called from another thread: nothing waiting for the server is resumed from there
+                co_await ios_.schedule();
+                on_stop();
+                timers_->armed().set(); // wake the ticker up if it sleeps
+            }
         };
 
         class client
@@ -93,7 +428,9 @@ namespace cppcoro {
             task<connection> connect(net::ip_endpoint const&endpoint) {
                 auto sock = net::create_tcp_socket<false>(ios_, endpoint);
                 co_await sock.connect(endpoint, cs_.token());
-                co_return connection{std::move(sock), cs_.token()};
+                // pipelined requests may be written and read on different threads
+                co_return connection{ios_, std::move(sock), cs_.token(),
+                                     std::make_unique<cppcoro::detail::synchronized_arena>()};
             }
 
             void stop() {
@@ -107,4 +444,4 @@ namespace cppcoro {
             cancellation_source cs_;
         };
     }
-}
\ No newline at end of file
+}
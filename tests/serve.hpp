@@ -0,0 +1,48 @@
+/**
+ * @file tests/serve.hpp
+ */
+#pragma once
+
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/net/ip_endpoint.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cppcoro/task.hpp>
+#include <cppcoro/when_all.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+
+namespace test {
+
+    /**
+     * @brief Loopback endpoint which port is picked by the system: concurrent test runs never collide.
+     */
+    inline const cppcoro::net::ip_endpoint any_port = *cppcoro::net::ip_endpoint::from_string("127.0.0.1:0");
+
+    /**
+     * @brief Serve @a server on @a ios until @a client_fn is done.
+     *
+     * @a client_fn is called with the endpoint the server listens on and returns the client task,
+     * the server is stopped once it completes.
+     */
+    template<typename ServerT, typename ClientFnT>
+    void serve(cppcoro::io_service &ios, ServerT &server, ClientFnT &&client_fn) {
+        using namespace cppcoro;
+        (void) sync_wait(when_all(
+            [&]() -> task<> {
+                auto _ = on_scope_exit([&] {
+                    ios.stop();
+                });
+                co_await server.serve();
+            }(),
+            [&]() -> task<> {
+                auto _ = on_scope_exit([&] {
+                    server.stop();
+                });
+                co_await client_fn(server.local_endpoint());
+            }(),
+            [&]() -> task<> {
+                ios.process_events();
+                co_return;
+            }()
+        ));
+    }
+}
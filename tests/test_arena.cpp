@@ -0,0 +1,189 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <cppcoro/details/arena.hpp>
+#include <cppcoro/http/route_controller.hpp>
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include "serve.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+    // global heap allocations made while set (single-threaded tests only)
+    bool count_allocations = false;
+    size_t allocation_count = 0;
+}
+
+void *operator new(std::size_t size) {
+    if (count_allocations) {
+        ++allocation_count;
+    }
+    if (auto *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+using namespace cppcoro;
+
+SCENARIO("arenas should be reused once released", "[cppcoro-http][arena]") {
+    GIVEN("An arena") {
+        detail::arena arena{1024};
+        WHEN("Allocations are made then released") {
+            auto *first = arena.allocate(100, 16);
+            auto *second = arena.allocate(100, 64);
+            REQUIRE(reinterpret_cast<std::uintptr_t>(second) % 64 == 0);
+            REQUIRE(arena.live_count() == 2);
+            arena.deallocate(second, 100, 64);
+            arena.deallocate(first, 100, 16);
+            THEN("The arena is rewound") {
+                REQUIRE(arena.live_count() == 0);
+                REQUIRE(arena.allocate(100, 16) == first);
+            }
+        }
+        WHEN("Allocations overflow a block") {
+            auto *small = arena.allocate(512, 16);
+            auto *large = arena.allocate(4096, 16);
+            arena.deallocate(small, 512, 16);
+            arena.deallocate(large, 4096, 16);
+            const auto capacity = arena.capacity();
+            THEN("Blocks are kept for the next round") {
+                REQUIRE(capacity >= 1024 + 4096);
+                REQUIRE(arena.allocate(512, 16) == small);
+                REQUIRE(arena.allocate(4096, 16) == large);
+                REQUIRE(arena.capacity() == capacity);
+            }
+        }
+    }
+}
+
+SCENARIO("arenas should reuse released allocations while others are alive", "[cppcoro-http][arena]") {
+    GIVEN("An arena with a long-lived allocation") {
+        detail::arena arena{1024};
+        auto *anchor = arena.allocate(100, 16);
+        WHEN("Allocations overlapping each other are made and released") {
+            auto *first = arena.allocate(300, 16);
+            auto *second = arena.allocate(1000, 16);
+            arena.deallocate(first, 300, 16);
+            const auto capacity = arena.capacity();
+            for (int ii = 0; ii < 1000; ++ii) {
+                auto *next = arena.allocate(300, 16);
+                arena.deallocate(second, 1000, 16);
+                second = arena.allocate(1000, 16);
+                arena.deallocate(next, 300, 16);
+            }
+            THEN("Released chunks are reused") {
+                REQUIRE(arena.live_count() == 2);
+                REQUIRE(arena.capacity() == capacity);
+                REQUIRE(arena.allocate(300, 16) == first);
+            }
+            arena.deallocate(second, 1000, 16);
+        }
+        arena.deallocate(anchor, 100, 16);
+    }
+}
+
+struct session
+{
+};
+
+using echo_controller_def = http::route_controller<R"(/echo/(\w+))",
+    session,
+    http::string_request,
+    struct echo_controller>;
+
+struct echo_controller : echo_controller_def
+{
+    using echo_controller_def::echo_controller_def;
+
+    auto on_get(std::string_view what) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, std::string{what}};
+    }
+};
+
+SCENARIO("connection arenas should stay bounded with overlapping requests", "[cppcoro-http][arena]") {
+    cppcoro::io_service ios;
+    GIVEN("A client connection with several pipelined requests in flight at any time") {
+        http::controller_server<session, echo_controller> server{ios, test::any_port};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            size_t warmed_up = 0;
+            // the frames of one lane's requests are released while the other lane's are alive:
+            // the arena is never rewound
+            auto lane = [&](std::string name) -> task<> {
+                for (int ii = 0; ii < 500; ++ii) {
+                    auto resp = co_await conn.get("/echo/" + name);
+                    REQUIRE(co_await resp->read_body() == name);
+                    if (ii == 50 and not warmed_up) {
+                        warmed_up = conn.arena().capacity();
+                    }
+                }
+            };
+            co_await when_all(lane("first"), lane("second"), lane("third"));
+            REQUIRE(warmed_up != 0);
+            REQUIRE(conn.arena().capacity() <= 2 * warmed_up);
+        });
+    }
+}
+
+using counted_controller_def = http::route_controller<R"(/counted/(\w+))",
+    session,
+    http::string_request,
+    struct counted_controller>;
+
+/**
+ * @brief Counts the global heap allocations made from the end of routing to the start of the handler.
+ */
+struct counted_controller : counted_controller_def
+{
+    using counted_controller_def::counted_controller_def;
+
+    static inline size_t dispatch_allocations = 0;
+
+    void init_request(std::string_view, http::string_request &) {
+        allocation_count = 0;
+        count_allocations = true;
+    }
+
+    auto on_get(std::string_view what) -> task<http::string_response> {
+        count_allocations = false;
+        dispatch_allocations = allocation_count;
+        co_return http::string_response{http::status::HTTP_STATUS_OK, std::string{what}};
+    }
+};
+
+SCENARIO("routed requests should reach their handler without hitting the global heap", "[cppcoro-http][arena]") {
+    cppcoro::io_service ios;
+    GIVEN("A warmed up connection to a server with several controllers") {
+        http::controller_server<session, echo_controller, counted_controller> server{ios, test::any_port};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            for (int ii = 0; ii < 10; ++ii) {
+                auto resp = co_await conn.get("/counted/warm");
+                REQUIRE(co_await resp->read_body() == "warm");
+            }
+            auto resp = co_await conn.get("/counted/hot");
+            REQUIRE(co_await resp->read_body() == "hot");
+            // the handler's own task frame, unless elided
+            REQUIRE(counted_controller::dispatch_allocations <= 1);
+        });
+    }
+}
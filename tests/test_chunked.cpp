@@ -7,14 +7,21 @@
 #include <cppcoro/http/http_server.hpp>
 #include <cppcoro/http/http_client.hpp>
 #include <cppcoro/http/http_chunk_provider.hpp>
-#include <cppcoro/sync_wait.hpp>
 #include <cppcoro/when_all.hpp>
-#include <cppcoro/on_scope_exit.hpp>
 #include <cppcoro/generator.hpp>
 #include <cppcoro/read_only_file.hpp>
 #include <cppcoro/write_only_file.hpp>
 #include <cppcoro/http/route_controller.hpp>
 
+#include "serve.hpp"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
 using namespace cppcoro;
 
 SCENARIO("chunked transfers should work", "[cppcoro-http][server][chunked]") {
@@ -69,47 +76,219 @@ SCENARIO("chunked transfers should work", "[cppcoro-http][server][chunked]") {
             , test_reader_controller
             , test_writer_controller
             >;
-        chunk_server server{ios, *net::ip_endpoint::from_string("127.0.0.1:4242")};
+        chunk_server server{ios, test::any_port};
 
         WHEN("...") {
             http::client client{ios};
-            sync_wait(when_all(
-                [&]() -> task<> {
-                    auto _ = on_scope_exit([&] {
-                        ios.stop();
-                    });
-                    co_await server.serve();
-                }(),
-                [&]() -> task<> {
-                    auto _ = on_scope_exit([&] {
-                        server.stop();
-                    });
-                    auto conn = co_await client.connect(*net::ip_endpoint::from_string("127.0.0.1:4242"));
-                    auto f = read_only_file::open(ios, __FILE__);
-                    std::string content;
-                    content.resize(f.size());
-                    auto[body, f_size] = co_await when_all(
-                        [&]() -> task<std::string> {
-                            auto response = co_await conn.get("/read");
-                            REQUIRE(response->status == http::status::HTTP_STATUS_OK);
-                            co_return std::string{co_await response->read_body()};
-                        }(),
-                        f.read(0, content.data(), content.size()));
-                    REQUIRE(body == content);
-                    auto response = co_await conn.post("/write/test.txt", std::move(body));
+            test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+                auto conn = co_await client.connect(endpoint);
+                auto f = read_only_file::open(ios, __FILE__);
+                std::string content;
+                content.resize(f.size());
+                auto[body, f_size] = co_await when_all(
+                    [&]() -> task<std::string> {
+                        auto response = co_await conn.get("/read");
+                        REQUIRE(response->status == http::status::HTTP_STATUS_OK);
+                        co_return std::string{co_await response->read_body()};
+                    }(),
+                    f.read(0, content.data(), content.size()));
+                REQUIRE(body == content);
+                auto response = co_await conn.post("/write/test.txt", std::move(body));
+                REQUIRE(response->status == http::status::HTTP_STATUS_OK);
+                auto f2 = read_only_file::open(ios, "test.txt");
+                std::string content2;
+                content2.resize(f2.size());
+                co_await f2.read(0, content2.data(), content2.size());
+                REQUIRE(content2 == content); // copied successful
+
+                // download straight to a file
+                http::write_only_file_processor download{ios};
+                download.init("download.txt");
+                auto downloaded = co_await conn.get("/read", std::move(download));
+                REQUIRE(downloaded->status == http::status::HTTP_STATUS_OK);
+                REQUIRE(downloaded->body_access.offset == content.size());
+                auto f3 = read_only_file::open(ios, "download.txt");
+                std::string content3;
+                content3.resize(f3.size());
+                co_await f3.read(0, content3.data(), content3.size());
+                REQUIRE(content3 == content);
+                co_return;
+            });
+        }
+    }
+}
+
+SCENARIO("file bodies are sent with their length", "[cppcoro-http][server][file]") {
+    io_service ios;
+
+    GIVEN("A file larger than the socket buffers") {
+        std::string content(8 * 1024 * 1024, '\0');
+        for (size_t ii = 0; ii < content.size(); ++ii) {
+            content[ii] = char('a' + ii % 26);
+        }
+        std::ofstream{"large_body.txt", std::ios::binary}.write(content.data(), std::streamsize(content.size()));
+
+        struct session
+        {
+        };
+
+        using large_file_controller_def = http::route_controller<
+            R"(/large)",
+            session,
+            http::string_request,
+            struct large_file_controller>;
+
+        struct large_file_controller : large_file_controller_def
+        {
+            using large_file_controller_def::large_file_controller_def;
+
+            auto on_get() -> task<http::read_only_file_chunked_response> {
+                co_return http::read_only_file_chunked_response{
+                    http::status::HTTP_STATUS_OK,
+                    http::read_only_file_chunk_provider{service(), "large_body.txt"}};
+            }
+        };
+
+        http::controller_server<session, large_file_controller> server{ios, test::any_port};
+
+        WHEN("it is downloaded twice on the same connection") {
+            http::client client{ios};
+            test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+                auto conn = co_await client.connect(endpoint);
+                for (int ii = 0; ii < 2; ++ii) {
+                    auto response = co_await conn.get("/large");
+                    REQUIRE(response->status == http::status::HTTP_STATUS_OK);
+                    REQUIRE(response->headers["Content-Length"] == std::to_string(content.size()));
+                    REQUIRE_FALSE(response->headers.contains("Transfer-Encoding"));
+                    // the whole body comes in, and the stream stays in sync for the next response
+                    REQUIRE(co_await response->read_body() == content);
+                }
+            });
+        }
+    }
+}
+
+SCENARIO("responses cut short close the connection", "[cppcoro-http][server][abort]") {
+    using namespace std::chrono_literals;
+    io_service ios;
+
+    GIVEN("A server answering with a body larger than the socket buffers") {
+        struct session
+        {
+        };
+
+        using large_body_controller_def = http::route_controller<
+            R"(/large)",
+            session,
+            http::string_request,
+            struct large_body_controller>;
+
+        struct large_body_controller : large_body_controller_def
+        {
+            using large_body_controller_def::large_body_controller_def;
+
+            auto on_get() -> task<http::string_response> {
+                co_return http::string_response{http::status::HTTP_STATUS_OK, std::string(8 * 1024 * 1024, 'a')};
+            }
+        };
+
+        http::controller_server<session, large_body_controller> server{ios, test::any_port};
+
+        WHEN("A client closes its connection in the middle of the response") {
+            http::client client{ios};
+            size_t open_connections = 0;
+            std::optional<http::string_response> next_response;
+            test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+                {
+                    auto sock = net::create_tcp_socket<false>(ios, endpoint);
+                    co_await sock.connect(endpoint);
+                    const std::string_view request = "GET /large HTTP/1.1\r\nHost: localhost\r\n\r\n";
+                    co_await sock.send(request.data(), request.size());
+                    std::array<char, 1024> buffer;
+                    REQUIRE(co_await sock.recv(buffer.data(), buffer.size()) > 0);
+                } // closed with unread data: reset
+                for (int ii = 0; ii < 100 and server.stats().connections != 0; ++ii) {
+                    co_await ios.schedule_after(10ms);
+                }
+                open_connections = server.stats().connections;
+                auto conn = co_await client.connect(endpoint);
+                next_response = co_await conn.get("/large");
+                co_await next_response->read_body();
+            });
+            THEN("The server closes it and keeps serving") {
+                REQUIRE(open_connections == 0);
+                REQUIRE(next_response->status == http::status::HTTP_STATUS_OK);
+                REQUIRE(next_response->body_access.size() == 8 * 1024 * 1024);
+            }
+        }
+    }
+}
+
+namespace {
+    /**
+     * @brief Chunked body made of a few in-memory parts.
+     */
+    struct parts_body
+    {
+        std::vector<std::string> parts;
+
+        async_generator<std::string_view> read(size_t) {
+            for (auto &part : parts) {
+                co_yield std::string_view{part};
+            }
+        }
+    };
+
+    static_assert(http::detail::ro_chunked_body<parts_body>);
+    static_assert(not http::detail::ro_file_body<parts_body>);
+}
+
+SCENARIO("chunked bodies follow the framing announced in their header", "[cppcoro-http][server][chunked]") {
+    io_service ios;
+
+    GIVEN("A server answering chunked bodies, with and without a Content-Length") {
+        struct session
+        {
+        };
+
+        using parts_controller_def = http::route_controller<
+            R"(/parts/(\w+))",
+            session,
+            http::string_request,
+            struct parts_controller>;
+
+        struct parts_controller : parts_controller_def
+        {
+            using parts_controller_def::parts_controller_def;
+
+            auto on_get(std::string_view framing) -> task<http::abstract_response<parts_body>> {
+                http::abstract_response<parts_body> response{http::status::HTTP_STATUS_OK,
+                                                             parts_body{{"hello", " ", "world"}}};
+                if (framing == "raw") {
+                    response.headers.set("Content-Length", "11");
+                } else {
+                    response.headers.set("Transfer-Encoding", "chunked"); // not repeated
+                }
+                response.headers.set("X-User-Agent", request().headers["User-Agent"]);
+                co_return response;
+            }
+        };
+
+        http::controller_server<session, parts_controller> server{ios, test::any_port};
+
+        WHEN("Both are requested on the same connection") {
+            http::client client{ios};
+            test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+                auto conn = co_await client.connect(endpoint);
+                for (std::string framing : {"chunked", "raw", "chunked"}) {
+                    auto response = co_await conn.get("/parts/" + framing);
                     REQUIRE(response->status == http::status::HTTP_STATUS_OK);
-                    auto f2 = read_only_file::open(ios, "test.txt");
-                    std::string content2;
-                    content2.resize(f2.size());
-                    co_await f2.read(0, content2.data(), content2.size());
-                    REQUIRE(content2 == content); // copied successful
-                    co_return;
-                }(),
-                [&]() -> task<> {
-                    ios.process_events();
-                    co_return;
-                }())
-            );
+                    REQUIRE(response->headers.contains("Transfer-Encoding") == (framing == "chunked"));
+                    REQUIRE(response->headers["X-User-Agent"] == "cppcoro-http/0.0");
+                    // the stream stays in sync for the next response
+                    REQUIRE(co_await response->read_body() == "hello world");
+                }
+            });
         }
     }
 }
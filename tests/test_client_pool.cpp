@@ -0,0 +1,162 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+
+#include <fmt/format.h>
+
+#include <cppcoro/http/client_pool.hpp>
+#include <cppcoro/http/route_controller.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include "serve.hpp"
+
+#include <array>
+#include <string>
+#include <string_view>
+
+using namespace cppcoro;
+
+struct session
+{
+};
+
+using echo_controller_def = http::route_controller<R"(/echo/(\w+))",
+    session,
+    http::string_request,
+    struct echo_controller>;
+
+struct echo_controller : echo_controller_def
+{
+    using echo_controller_def::echo_controller_def;
+
+    auto on_get(std::string_view what) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, std::string{what}};
+    }
+};
+
+SCENARIO("client pools should reuse connections", "[cppcoro-http][client][pool]") {
+    cppcoro::io_service ios;
+    GIVEN("A server and a client pool") {
+        http::controller_server<session, echo_controller> server{ios, test::any_port};
+        http::client client{ios};
+        http::client_pool pool{client, {.max_idle = 1, .max_per_host = 2}};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            {
+                auto conn = co_await pool.acquire(endpoint);
+                auto resp = co_await conn->get("/echo/first");
+                REQUIRE(co_await resp->read_body() == "first");
+            }
+            REQUIRE(pool.idle(endpoint) == 1);
+            {
+                auto conn = co_await pool.acquire(endpoint);
+                REQUIRE(pool.idle(endpoint) == 0);
+                auto resp = co_await conn->get("/echo/second");
+                REQUIRE(co_await resp->read_body() == "second");
+            }
+            REQUIRE(server.stats().connections == 1);
+
+            // 3 concurrent users for 2 connections: the last one waits
+            auto use = [&](std::string what) -> task<> {
+                auto conn = co_await pool.acquire(endpoint);
+                auto resp = co_await conn->get(fmt::format("/echo/{}", what));
+                REQUIRE(co_await resp->read_body() == what);
+            };
+            co_await when_all(use("a"), use("b"), use("c"));
+            REQUIRE(pool.idle(endpoint) == 1);
+        });
+    }
+}
+
+SCENARIO("client connections should pipeline concurrent requests", "[cppcoro-http][client][pipelining]") {
+    cppcoro::io_service ios;
+    GIVEN("A server and one client connection") {
+        http::controller_server<session, echo_controller> server{ios, test::any_port};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            auto [first, second, third] = co_await when_all(conn.get("/echo/first"),
+                                                            conn.get("/echo/second"),
+                                                            conn.get("/echo/third"));
+            REQUIRE(co_await first->read_body() == "first");
+            REQUIRE(co_await second->read_body() == "second");
+            REQUIRE(co_await third->read_body() == "third");
+        });
+    }
+}
+
+SCENARIO("a failed pipelined request should abort the requests queued behind it", "[cppcoro-http][client][pipelining]") {
+    cppcoro::io_service ios;
+    GIVEN("A peer answering the first of three pipelined requests, then closing the connection") {
+        auto listening = net::create_tcp_socket<true>(ios, test::any_port);
+        listening.listen();
+        http::client client{ios};
+
+        auto peer = [&]() -> task<> {
+            auto sock = net::create_tcp_socket<false>(ios, test::any_port);
+            co_await listening.accept(sock);
+            std::string requests;
+            std::array<char, 1024> buffer{};
+            auto heads = [&] {
+                size_t count = 0;
+                for (auto pos = requests.find("\r\n\r\n"); pos != std::string::npos;
+                     pos = requests.find("\r\n\r\n", pos + 4)) {
+                    ++count;
+                }
+                return count;
+            };
+            while (heads() < 3) {
+                auto size = co_await sock.recv(buffer.data(), buffer.size());
+                if (size == 0) {
+                    co_return;
+                }
+                requests.append(buffer.data(), size);
+            }
+            const std::string_view response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nfirst";
+            co_await sock.send(response.data(), response.size());
+            sock.close_send();
+            while (co_await sock.recv(buffer.data(), buffer.size()) != 0) {
+            }
+        };
+        auto fetch = [](auto &conn, std::string path) -> task<std::string> {
+            try {
+                auto response = co_await conn.get(std::move(path));
+                if (not response) {
+                    co_return "<none>";
+                }
+                co_return std::string{co_await response->read_body()};
+            } catch (const std::system_error &) {
+                co_return "<failed>";
+            }
+        };
+
+        WHEN("The second response never comes") {
+            std::string first, third;
+            (void) sync_wait(when_all(
+                [&]() -> task<> {
+                    auto _ = on_scope_exit([&] {
+                        ios.stop();
+                    });
+                    co_await when_all(peer(), [&]() -> task<> {
+                        auto conn = co_await client.connect(listening.local_endpoint());
+                        auto [a, b, c] = co_await when_all(fetch(conn, "/first"),
+                                                           fetch(conn, "/second"),
+                                                           fetch(conn, "/third"));
+                        first = std::move(a);
+                        third = std::move(c);
+                    }());
+                }(),
+                [&]() -> task<> {
+                    ios.process_events();
+                    co_return;
+                }()
+            ));
+            THEN("The requests behind it fail instead of reading a stream out of sync") {
+                REQUIRE(first == "first");
+                REQUIRE(third == "<failed>");
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <cppcoro/http/details/codel.hpp>
+
+using namespace cppcoro;
+using namespace std::chrono_literals;
+
+SCENARIO("codel should shed requests only under persistent delay", "[cppcoro-http][codel]") {
+    GIVEN("A codel controller") {
+        http::detail::codel codel;
+        const auto start = http::detail::codel::clock::now();
+        constexpr auto target = 5ms;
+        constexpr auto interval = 100ms;
+        WHEN("The queueing delay stays under the target") {
+            bool dropped = false;
+            for (auto t = 0ms; t < 1s; t += 1ms) {
+                dropped |= codel.drop(1ms, target, interval, start + t);
+            }
+            THEN("Nothing is dropped") {
+                REQUIRE_FALSE(dropped);
+                REQUIRE_FALSE(codel.dropping());
+            }
+        }
+        WHEN("The queueing delay goes above the target for less than an interval") {
+            bool dropped = false;
+            for (auto t = 0ms; t < 1s; t += 1ms) {
+                const auto delay = (t % 100ms) < 50ms ? 20ms : 1ms;
+                dropped |= codel.drop(delay, target, interval, start + t);
+            }
+            THEN("Nothing is dropped") {
+                REQUIRE_FALSE(dropped);
+            }
+        }
+        WHEN("The queueing delay stays above the target") {
+            size_t first_drops = 0;
+            size_t last_drops = 0;
+            for (auto t = 0ms; t < 1s; t += 1ms) {
+                const bool dropped = codel.drop(20ms, target, interval, start + t);
+                if (t < 500ms) {
+                    first_drops += dropped;
+                } else {
+                    last_drops += dropped;
+                }
+            }
+            THEN("Requests are dropped at an increasing rate") {
+                REQUIRE(codel.dropping());
+                REQUIRE(first_drops > 0);
+                REQUIRE(last_drops > first_drops);
+                AND_WHEN("The delay gets back under the target") {
+                    codel.drop(1ms, target, interval, start + 1s);
+                    THEN("Dropping stops") {
+                        REQUIRE_FALSE(codel.dropping());
+                        REQUIRE_FALSE(codel.drop(20ms, target, interval, start + 1s + 1ms));
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,166 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <cppcoro/http/dynamic_router.hpp>
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include "serve.hpp"
+
+#include <fmt/format.h>
+
+#include <memory>
+#include <optional>
+
+using namespace cppcoro;
+
+namespace {
+    using lookup_status = http::dynamic_router::lookup_status;
+
+    auto lookup(http::dynamic_router::reader &reader, http::method method, std::string path) {
+        auto routes = reader.acquire();
+        std::vector<std::string_view> captures;
+        http::string_request request{method, std::move(path)};
+        auto route = routes.find(method, request.path, captures);
+        if (route.status != lookup_status::found) {
+            return std::pair{route.status, std::string{}};
+        }
+        auto response = sync_wait((*route.handler)(request, captures));
+        return std::pair{route.status, response.body_access};
+    }
+}
+
+SCENARIO("routes can be registered at runtime", "[cppcoro-http][router][dynamic]") {
+    GIVEN("A dynamic router") {
+        http::dynamic_router router;
+        http::dynamic_router::reader reader{router};
+        router.add<int>(http::method::get, "/tenants/{}/status",
+                        [](http::string_request &, int tenant) -> task<http::string_response> {
+                            co_return http::string_response{http::status::HTTP_STATUS_OK,
+                                                            fmt::format("status {}", tenant)};
+                        });
+        router.add<std::string>(http::method::get, "/tenants/{}/name",
+                                [](http::string_request &, std::string tenant) -> task<http::string_response> {
+                                    co_return http::string_response{http::status::HTTP_STATUS_OK,
+                                                                    fmt::format("name {}", tenant)};
+                                });
+        router.add(http::method::get, "/tenants/admin/status",
+                   [](http::string_request &) -> task<http::string_response> {
+                       co_return http::string_response{http::status::HTTP_STATUS_OK, "admin"};
+                   });
+        router.add(http::method::get, "/static/a/b",
+                   [](http::string_request &) -> task<http::string_response> {
+                       co_return http::string_response{http::status::HTTP_STATUS_OK, "b"};
+                   });
+        router.add(http::method::get, "/static/a/c",
+                   [](http::string_request &) -> task<http::string_response> {
+                       co_return http::string_response{http::status::HTTP_STATUS_OK, "c"};
+                   });
+        router.add<std::filesystem::path>(http::method::get, "/files/{}",
+                                          [](http::string_request &, std::filesystem::path path) -> task<http::string_response> {
+                                              co_return http::string_response{http::status::HTTP_STATUS_OK, path.string()};
+                                          });
+        WHEN("Urls are looked up") {
+            THEN("Typed captures are loaded") {
+                REQUIRE(lookup(reader, http::method::get, "/tenants/42/status").second == "status 42");
+                REQUIRE(lookup(reader, http::method::get, "/tenants/acme/name").second == "name acme");
+                REQUIRE(lookup(reader, http::method::get, "/files/a/b.txt?v=1").second == "a/b.txt");
+            }
+            THEN("Literals have precedence over captures") {
+                REQUIRE(lookup(reader, http::method::get, "/tenants/admin/status").second == "admin");
+            }
+            THEN("Split edges are still reachable") {
+                REQUIRE(lookup(reader, http::method::get, "/static/a/b").second == "b");
+                REQUIRE(lookup(reader, http::method::get, "/static/a/c").second == "c");
+                REQUIRE(lookup(reader, http::method::get, "/static/a").first == lookup_status::not_found);
+            }
+            THEN("Captures are validated") {
+                REQUIRE(lookup(reader, http::method::get, "/tenants/acme/status").first == lookup_status::not_found);
+            }
+            THEN("Unregistered methods are reported") {
+                REQUIRE(lookup(reader, http::method::post, "/tenants/42/status").first == lookup_status::method_not_allowed);
+            }
+        }
+        WHEN("A route is removed while a snapshot is held") {
+            auto routes = reader.acquire();
+            REQUIRE(router.remove(http::method::get, "/static/a/b"));
+            THEN("The snapshot is unchanged, new snapshots see the removal") {
+                std::vector<std::string_view> captures;
+                REQUIRE(routes.find(http::method::get, "/static/a/b", captures).status == lookup_status::found);
+                REQUIRE(lookup(reader, http::method::get, "/static/a/b").first == lookup_status::not_found);
+                REQUIRE(lookup(reader, http::method::get, "/static/a/c").second == "c");
+            }
+        }
+        WHEN("The routes sharing an edge are removed one by one") {
+            REQUIRE(router.remove(http::method::get, "/static/a/c"));
+            THEN("The remaining route is still reachable") {
+                REQUIRE(lookup(reader, http::method::get, "/static/a/b").second == "b");
+                REQUIRE(lookup(reader, http::method::get, "/static/a").first == lookup_status::not_found);
+            }
+            AND_WHEN("The last one is removed") {
+                REQUIRE(router.remove(http::method::get, "/static/a/b"));
+                THEN("Its branch is gone, it can be registered again") {
+                    REQUIRE(lookup(reader, http::method::get, "/static/a/b").first == lookup_status::not_found);
+                    REQUIRE_FALSE(router.remove(http::method::get, "/static/a/b"));
+                    router.add(http::method::get, "/static/a/b",
+                               [](http::string_request &) -> task<http::string_response> {
+                                   co_return http::string_response{http::status::HTTP_STATUS_OK, "b again"};
+                               });
+                    REQUIRE(lookup(reader, http::method::get, "/static/a/b").second == "b again");
+                    REQUIRE(lookup(reader, http::method::get, "/tenants/42/status").second == "status 42");
+                }
+            }
+        }
+        WHEN("A handler is replaced while snapshots overlap") {
+            auto state = std::make_shared<int>(0);
+            std::weak_ptr<int> replaced = state;
+            router.add(http::method::get, "/replaced",
+                       [state = std::move(state)](http::string_request &) -> task<http::string_response> {
+                           co_return http::string_response{http::status::HTTP_STATUS_OK, "old"};
+                       });
+            auto old_routes = std::make_optional(reader.acquire());
+            router.add(http::method::get, "/replaced",
+                       [](http::string_request &) -> task<http::string_response> {
+                           co_return http::string_response{http::status::HTTP_STATUS_OK, "new"};
+                       });
+            auto new_routes = reader.acquire();
+            old_routes.reset();
+            THEN("The replaced tree is released with its last snapshot") {
+                REQUIRE(replaced.expired());
+                REQUIRE(lookup(reader, http::method::get, "/replaced").second == "new");
+            }
+        }
+        WHEN("Patterns do not match the parameters") {
+            THEN("Registration fails") {
+                REQUIRE_THROWS_AS(router.add<int>(http::method::get, "/none",
+                                                  [](http::string_request &, int) -> task<http::string_response> {
+                                                      co_return http::string_response{http::status::HTTP_STATUS_OK};
+                                                  }), std::invalid_argument);
+            }
+        }
+    }
+}
+
+SCENARIO("dynamic servers serve routes added while serving", "[cppcoro-http][router][dynamic]") {
+    cppcoro::io_service ios;
+    GIVEN("A dynamic server") {
+        http::dynamic_router router;
+        http::dynamic_server server{ios, test::any_port, router};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            auto resp = co_await conn.get("/hello/world");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_NOT_FOUND);
+            router.add<std::string>(http::method::get, "/hello/{}",
+                                    [](http::string_request &, std::string who) -> task<http::string_response> {
+                                        co_return http::string_response{http::status::HTTP_STATUS_OK,
+                                                                        fmt::format("hello {}", who)};
+                                    });
+            resp = co_await conn.get("/hello/world");
+            REQUIRE(co_await resp->read_body() == "hello world");
+        });
+    }
+}
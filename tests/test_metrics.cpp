@@ -0,0 +1,210 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+
+#include <cppcoro/http/metrics_controller.hpp>
+#include <cppcoro/http/dynamic_router.hpp>
+#include <cppcoro/http/http_chunk_provider.hpp>
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include "serve.hpp"
+
+#include <fmt/format.h>
+
+#include <thread>
+#include <vector>
+
+using namespace cppcoro;
+using namespace std::chrono_literals;
+
+SCENARIO("metrics are recorded per thread and merged when collected", "[cppcoro-http][metrics]") {
+    auto &metrics = http::metrics::global();
+    GIVEN("Several threads recording") {
+        const auto route = metrics.route("/test/merge");
+        const auto before = metrics.collect();
+        std::vector<std::thread> threads;
+        for (int ii = 0; ii < 4; ++ii) {
+            threads.emplace_back([route] {
+                for (int jj = 0; jj < 1000; ++jj) {
+                    auto &shard = http::metrics::local();
+                    shard.requests.add();
+                    shard.bytes_in.add(10);
+                    shard.route(route);
+                    shard.status(418);
+                    shard.parse_latency.record(3us);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        THEN("the collected values are the sums of all threads") {
+            const auto after = metrics.collect();
+            REQUIRE(after.requests - before.requests == 4000);
+            REQUIRE(after.bytes_in - before.bytes_in == 40000);
+            REQUIRE(after.route("/test/merge") - before.route("/test/merge") == 4000);
+            REQUIRE(after.status(418) - before.status(418) == 4000);
+            REQUIRE(after.parse_latency.count - before.parse_latency.count == 4000);
+            // 3us goes into the (2.5us, 5us] bucket
+            REQUIRE(after.parse_latency.buckets[2] - before.parse_latency.buckets[2] == 4000);
+        }
+        AND_WHEN("the route is registered again") {
+            THEN("it gets the same index") {
+                REQUIRE(metrics.route("/test/merge") == route);
+            }
+        }
+    }
+}
+
+SCENARIO("metrics are rendered in Prometheus text format", "[cppcoro-http][metrics]") {
+    auto &metrics = http::metrics::global();
+    GIVEN("A route which label must be escaped") {
+        http::metrics::local().route(metrics.route(R"(/test/"quoted"/(\d+))"));
+        WHEN("metrics are rendered") {
+            const auto text = metrics.render();
+            THEN("every metric has its type and labels are escaped") {
+                REQUIRE(text.find("# TYPE http_server_requests_total counter\n") != std::string::npos);
+                REQUIRE(text.find("# TYPE http_server_connections_active gauge\n") != std::string::npos);
+                REQUIRE(text.find("# TYPE http_server_parse_duration_seconds histogram\n") != std::string::npos);
+                REQUIRE(text.find("http_server_parse_duration_seconds_bucket{le=\"+Inf\"}") != std::string::npos);
+                REQUIRE(text.find(R"x(http_server_route_requests_total{route="/test/\"quoted\"/(\\d+)"} 1)x")
+                        != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("invalid status codes are counted apart", "[cppcoro-http][metrics]") {
+    auto &metrics = http::metrics::global();
+    GIVEN("Responses with out of range status codes") {
+        const auto before = metrics.collect();
+        http::metrics::local().status(42);
+        http::metrics::local().status(700);
+        http::metrics::local().status(-1);
+        WHEN("metrics are collected and rendered") {
+            const auto after = metrics.collect();
+            const auto text = metrics.render();
+            THEN("they go to the other series") {
+                REQUIRE(after.other_statuses - before.other_statuses == 3);
+                REQUIRE(after.status(0) == 0);
+                REQUIRE(after.status(42) == 0);
+                REQUIRE(text.find(R"(http_server_responses_total{status="other"})") != std::string::npos);
+                REQUIRE(text.find(R"(http_server_responses_total{status="0"})") == std::string::npos);
+            }
+        }
+    }
+}
+
+struct session
+{
+};
+
+using hello_controller_def = http::route_controller<R"(/hello/(\w+))",
+    session,
+    http::string_request,
+    struct hello_controller>;
+
+struct hello_controller : hello_controller_def
+{
+    using hello_controller_def::hello_controller_def;
+
+    auto on_get(const std::string &who) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, fmt::format("get: {}", who)};
+    }
+};
+
+SCENARIO("servers expose their metrics", "[cppcoro-http][metrics]") {
+    cppcoro::io_service ios;
+    GIVEN("A server with a metrics controller") {
+        http::controller_server<session, hello_controller, http::metrics_controller> server{ios, test::any_port};
+        http::client client{ios};
+        const auto before = http::metrics::global().collect();
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            auto resp = co_await conn.get("/hello/world");
+            REQUIRE(co_await resp->read_body() == "get: world");
+            resp = co_await conn.get("/nowhere");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_NOT_FOUND);
+            resp = co_await conn.get("/metrics");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_OK);
+            const auto text = std::string{co_await resp->read_body()};
+            REQUIRE(text.find(R"x(http_server_route_requests_total{route="/hello/(\\w+)"})x") != std::string::npos);
+            REQUIRE(text.find(R"(http_server_responses_total{status="404"})") != std::string::npos);
+
+            const auto after = http::metrics::global().collect();
+            REQUIRE(after.accepted_connections - before.accepted_connections == 1);
+            REQUIRE(after.active_connections - before.active_connections == 1);
+            REQUIRE(after.requests - before.requests == 3);
+            REQUIRE(after.route(hello_controller::route_pattern) - before.route(hello_controller::route_pattern) == 1);
+            REQUIRE(after.route(http::metrics::unmatched_route) - before.route(http::metrics::unmatched_route) == 1);
+            REQUIRE(after.status(200) - before.status(200) >= 1);
+            REQUIRE(after.status(404) - before.status(404) == 1);
+            REQUIRE(after.bytes_in > before.bytes_in);
+            REQUIRE(after.bytes_out > before.bytes_out);
+            REQUIRE(after.parse_latency.count - before.parse_latency.count == 3);
+        });
+    }
+}
+
+using missing_file_controller_def = http::route_controller<R"(/missing)",
+    session,
+    http::string_request,
+    struct missing_file_controller>;
+
+struct missing_file_controller : missing_file_controller_def
+{
+    using missing_file_controller_def::missing_file_controller_def;
+
+    auto on_get() -> task<http::read_only_file_chunked_response> {
+        co_return http::read_only_file_chunked_response{http::status::HTTP_STATUS_OK,
+                                                        http::read_only_file_chunk_provider{service(), "missing.txt"}};
+    }
+};
+
+SCENARIO("responses replaced by an error response are recorded with its status", "[cppcoro-http][metrics]") {
+    cppcoro::io_service ios;
+    GIVEN("A server answering with a file that does not exist") {
+        http::controller_server<session, missing_file_controller> server{ios, test::any_port};
+        http::client client{ios};
+        const auto before = http::metrics::global().collect();
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            auto resp = co_await conn.get("/missing");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_NOT_FOUND);
+
+            const auto after = http::metrics::global().collect();
+            REQUIRE(after.status(404) - before.status(404) == 1);
+            REQUIRE(after.status(200) - before.status(200) == 0);
+        });
+    }
+}
+
+SCENARIO("dynamic servers record their routes", "[cppcoro-http][metrics][dynamic]") {
+    cppcoro::io_service ios;
+    GIVEN("A dynamic server") {
+        http::dynamic_router router;
+        router.add<int>(http::method::get, "/metrics-test/{}",
+                        [](http::string_request &, int id) -> task<http::string_response> {
+                            co_return http::string_response{http::status::HTTP_STATUS_OK, fmt::format("{}", id)};
+                        });
+        http::dynamic_server server{ios, test::any_port, router};
+        http::client client{ios};
+        const auto before = http::metrics::global().collect();
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            auto resp = co_await conn.get("/metrics-test/42");
+            REQUIRE(co_await resp->read_body() == "42");
+            resp = co_await conn.get("/nowhere");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_NOT_FOUND);
+
+            const auto after = http::metrics::global().collect();
+            REQUIRE(after.route("/metrics-test/{}") - before.route("/metrics-test/{}") == 1);
+            REQUIRE(after.route(http::metrics::unmatched_route) - before.route(http::metrics::unmatched_route) == 1);
+        });
+    }
+}
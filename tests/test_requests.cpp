@@ -10,6 +10,8 @@
 #include <cppcoro/io_service.hpp>
 #include <cppcoro/on_scope_exit.hpp>
 
+#include <string>
+
 using namespace cppcoro;
 
 SCENARIO("requests should be customizable", "[cppcoro-http][messages][request]") {
@@ -44,3 +46,115 @@ SCENARIO("requests should be customizable", "[cppcoro-http][messages][request]")
         }
     }
 }
+
+SCENARIO("pipelined requests should be parsed one by one", "[cppcoro-http][messages][pipelining]") {
+    GIVEN("Two requests received in the same buffer") {
+        http::string_request first{http::method::get, "/first"};
+        http::string_request second{http::method::post, "/second", "hello"};
+        const auto input = first.build_header() + second.build_header() + second.body_access;
+        WHEN("The buffer is parsed") {
+            http::request_parser parser;
+            const auto consumed = parser.parse(input);
+            THEN("Only the first request is consumed") {
+                REQUIRE(parser);
+                REQUIRE(parser.url() == "/first");
+                REQUIRE(consumed < input.size());
+                AND_THEN("The remaining bytes hold the second request") {
+                    http::request_parser next;
+                    REQUIRE(next.parse(input.data() + consumed, input.size() - consumed) == input.size() - consumed);
+                    REQUIRE(next);
+                    REQUIRE(next.method() == http::method::post);
+                    REQUIRE(next.url() == "/second");
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("requests split on arbitrary boundaries should be parsed", "[cppcoro-http][messages][streaming]") {
+    GIVEN("A request with headers and a body") {
+        http::string_request req{http::method::post, "/split", "hello world", http::headers{{"X-Test", "some value"}}};
+        const auto input = req.build_header() + req.body_access;
+        WHEN("It is received byte by byte") {
+            http::string_request result;
+            http::request_parser parser;
+            sync_wait([&]() -> task<> {
+                for (auto c : input) {
+                    parser.parse(&c, 1);
+                    co_await parser.load(result);
+                }
+            }());
+            THEN("Nothing is lost") {
+                REQUIRE(parser);
+                REQUIRE(result.method == http::method::post);
+                REQUIRE(result.path == "/split");
+                REQUIRE(result.headers["X-Test"] == "some value");
+                REQUIRE(result.body_access == "hello world");
+            }
+        }
+    }
+}
+
+SCENARIO("headers lookup should be case insensitive", "[cppcoro-http][messages][headers]") {
+    GIVEN("Some headers") {
+        http::headers headers{{"Content-Type", "text/html"}, {"X-Test", "1"}};
+        WHEN("A field is set with another case") {
+            headers.set("content-type", "text/plain");
+            THEN("The existing field is updated in place") {
+                REQUIRE(headers.size() == 2);
+                REQUIRE(headers["CONTENT-TYPE"] == "text/plain");
+                REQUIRE((*headers.begin()).first == "Content-Type");
+            }
+        }
+        WHEN("Fields are set to longer and longer values") {
+            for (size_t ii = 1; ii <= 200; ++ii) {
+                headers.set("Content-Type", std::string(ii, 'c'));
+                headers.set("X-Test", std::string(ii, 'x'));
+            }
+            THEN("Replaced values do not pile up in the buffer") {
+                REQUIRE(headers.size() == 2);
+                REQUIRE(headers["Content-Type"] == std::string(200, 'c'));
+                REQUIRE(headers["X-Test"] == std::string(200, 'x'));
+                REQUIRE(headers.storage_size() <= 2 * (200 + 200 + 18));
+            }
+        }
+    }
+}
+
+SCENARIO("the SIMD parser backend should parse chunked requests", "[cppcoro-http][messages][simd]") {
+    using simd_request_parser = http::detail::static_parser_handler<true, http::detail::simd_parser_backend<true>>;
+    GIVEN("A chunked request followed by a pipelined one") {
+        const std::string input = "POST /upload HTTP/1.1\r\n"
+                                  "Transfer-Encoding: chunked\r\n"
+                                  "X-Test: some value\r\n"
+                                  "\r\n"
+                                  "5\r\nhello\r\n"
+                                  "6;ext=1\r\n world\r\n"
+                                  "0\r\n\r\n"
+                                  "GET /next HTTP/1.1\r\n\r\n";
+        WHEN("It is received byte by byte") {
+            http::string_request result;
+            simd_request_parser parser;
+            size_t consumed = 0;
+            sync_wait([&]() -> task<> {
+                while (not parser) {
+                    consumed += parser.parse(input.data() + consumed, 1);
+                    co_await parser.load(result);
+                }
+            }());
+            THEN("The first request is fully loaded") {
+                REQUIRE(result.method == http::method::post);
+                REQUIRE(result.path == "/upload");
+                REQUIRE(result.headers["x-test"] == "some value");
+                REQUIRE(result.body_access == "hello world");
+                AND_THEN("The remaining bytes hold the second request") {
+                    simd_request_parser next;
+                    REQUIRE(next.parse(input.data() + consumed, input.size() - consumed) == input.size() - consumed);
+                    REQUIRE(next);
+                    REQUIRE(next.method() == http::method::get);
+                    REQUIRE(next.url() == "/next");
+                }
+            }
+        }
+    }
+}
@@ -7,9 +7,14 @@
 #include <cppcoro/http/route_controller.hpp>
 #include <cppcoro/http/http_client.hpp>
 #include <cppcoro/io_service.hpp>
-#include <cppcoro/sync_wait.hpp>
 #include <cppcoro/when_all.hpp>
-#include <cppcoro/on_scope_exit.hpp>
+
+#include "serve.hpp"
+
+#include <array>
+#include <chrono>
+#include <string_view>
+#include <vector>
 
 using namespace cppcoro;
 
@@ -39,34 +44,234 @@ struct hello_controller : hello_controller_def
 
 SCENARIO("route controller are easy to use", "[cppcoro-http][router]") {
     cppcoro::io_service ios;
-    static const auto test_endpoint = net::ip_endpoint::from_string("127.0.0.1:4242");
     GIVEN("A simple route controller") {
-        http::controller_server<session, hello_controller> server{ios,
-                                                                  *test_endpoint};
+        http::controller_server<session, hello_controller> server{ios, test::any_port};
         http::client client{ios};
 
-        (void) sync_wait(when_all(
-            [&]() -> task<> {
-                auto _ = on_scope_exit([&] {
-                    ios.stop();
-                });
-                co_await server.serve();
-            }(),
-            [&]() -> task<> {
-                auto _ = on_scope_exit([&] {
-                    server.stop();
-                });
-                using namespace std::chrono_literals;
-                auto conn = co_await client.connect(*test_endpoint);
-                auto resp = co_await conn.post("/hello/world");
-                REQUIRE(co_await resp->read_body() == "post: world");
-                resp = co_await conn.get("/hello/world");
-                REQUIRE(co_await resp->read_body() == "get: world");
-            }(),
-            [&]() -> task<> {
-                ios.process_events();
-                co_return;
-            }()
-        ));
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            using namespace std::chrono_literals;
+            auto conn = co_await client.connect(endpoint);
+            auto resp = co_await conn.post("/hello/world");
+            REQUIRE(co_await resp->read_body() == "post: world");
+            resp = co_await conn.get("/hello/world");
+            REQUIRE(co_await resp->read_body() == "get: world");
+        });
+    }
+}
+
+using add_controller_def = http::route_controller<R"(/add/(\d+)/(\d+))",
+    session,
+    http::string_request,
+    struct add_controller>;
+
+struct add_controller : add_controller_def
+{
+    using add_controller_def::add_controller_def;
+
+    auto on_get(int lhs, int rhs) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, fmt::format("{}", lhs + rhs)};
+    }
+};
+
+static_assert(hello_controller::route_prefix == "/hello/");
+static_assert(add_controller::route_prefix == "/add/");
+
+SCENARIO("requests are routed to the right controller", "[cppcoro-http][router]") {
+    cppcoro::io_service ios;
+    GIVEN("A server with several route controllers") {
+        http::controller_server<session, add_controller, hello_controller> server{ios, test::any_port};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            auto resp = co_await conn.get("/hello/world");
+            REQUIRE(co_await resp->read_body() == "get: world");
+            resp = co_await conn.get("/add/40/2");
+            REQUIRE(co_await resp->read_body() == "42");
+            resp = co_await conn.post("/add/40/2");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_METHOD_NOT_ALLOWED);
+            resp = co_await conn.get("/add/forty/2");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_NOT_FOUND);
+            resp = co_await conn.get("/nowhere");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_NOT_FOUND);
+        });
+    }
+}
+
+using item_controller_def = http::route_controller<R"(/items/(\d+))",
+    session,
+    http::string_request,
+    struct item_controller>;
+
+struct item_controller : item_controller_def
+{
+    static inline int constructed = 0;
+
+    explicit item_controller(io_service &service)
+        : item_controller_def{service} {
+        ++constructed;
+    }
+
+    auto on_get(int id) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, fmt::format("item {}", id)};
+    }
+};
+
+using item_name_controller_def = http::route_controller<R"(/items/(\w+)/name)",
+    session,
+    http::string_request,
+    struct item_name_controller>;
+
+struct item_name_controller : item_name_controller_def
+{
+    static inline int constructed = 0;
+
+    explicit item_name_controller(io_service &service)
+        : item_name_controller_def{service} {
+        ++constructed;
+    }
+
+    auto on_get(std::string_view item) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, fmt::format("name of {}", item)};
+    }
+};
+
+SCENARIO("controllers sharing a prefix are only built when their route matches", "[cppcoro-http][router]") {
+    cppcoro::io_service ios;
+    GIVEN("A server with two controllers under the same prefix") {
+        http::controller_server<session, item_controller, item_name_controller> server{ios, test::any_port};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto conn = co_await client.connect(endpoint);
+            for (int ii = 0; ii < 3; ++ii) {
+                auto resp = co_await conn.get("/items/abc/name");
+                REQUIRE(co_await resp->read_body() == "name of abc");
+            }
+            for (int ii = 0; ii < 3; ++ii) {
+                auto resp = co_await conn.get("/items/42");
+                REQUIRE(co_await resp->read_body() == "item 42");
+            }
+            // a connection keeps its controller while its route matches, a miss builds nothing
+            REQUIRE(item_name_controller::constructed == 1);
+            REQUIRE(item_controller::constructed == 1);
+        });
+    }
+}
+
+SCENARIO("pipelined requests are answered in order", "[cppcoro-http][router][pipelining]") {
+    cppcoro::io_service ios;
+    GIVEN("A server with a route controller") {
+        http::controller_server<session, add_controller> server{ios, test::any_port};
+
+        WHEN("Several requests come in a single send") {
+            std::string responses;
+            test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+                auto sock = net::create_tcp_socket<false>(ios, endpoint);
+                co_await sock.connect(endpoint);
+                const std::string_view requests = "GET /add/1/1 HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                                                  "GET /add/2/2 HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                                                  "GET /add/3/3 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+                co_await sock.send(requests.data(), requests.size());
+                sock.close_send();
+                std::array<char, 1024> buffer{};
+                while (auto size = co_await sock.recv(buffer.data(), buffer.size())) {
+                    responses.append(buffer.data(), size);
+                }
+            });
+            THEN("Every response is sent, in request order") {
+                const auto first = responses.find("\r\n\r\n2");
+                const auto second = responses.find("\r\n\r\n4");
+                const auto third = responses.find("\r\n\r\n6");
+                REQUIRE(first != std::string::npos);
+                REQUIRE(second != std::string::npos);
+                REQUIRE(third != std::string::npos);
+                REQUIRE(first < second);
+                REQUIRE(second < third);
+            }
+        }
+    }
+}
+
+SCENARIO("concurrent connections do not share controller state", "[cppcoro-http][router]") {
+    cppcoro::io_service ios;
+    GIVEN("A server and two client connections") {
+        http::controller_server<session, add_controller, hello_controller> server{ios, test::any_port};
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto run = [&](int offset) -> task<> {
+                auto conn = co_await client.connect(endpoint);
+                for (int ii = 0; ii < 10; ++ii) {
+                    auto resp = co_await conn.get(fmt::format("/add/{}/{}", offset, ii));
+                    REQUIRE(co_await resp->read_body() == fmt::format("{}", offset + ii));
+                    resp = co_await conn.get(fmt::format("/hello/{}", offset));
+                    REQUIRE(co_await resp->read_body() == fmt::format("get: {}", offset));
+                }
+            };
+            co_await when_all(run(100), run(200));
+        });
+    }
+}
+
+SCENARIO("connections over the limits are rejected", "[cppcoro-http][router][admission]") {
+    cppcoro::io_service ios;
+    GIVEN("A server accepting one connection per peer") {
+        http::controller_server<session, add_controller> server{ios, test::any_port};
+        server.limits({.max_connections_per_peer = 1, .overload = http::admission_limits::policy::reject});
+        http::client client{ios};
+
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            auto first = co_await client.connect(endpoint);
+            auto resp = co_await first.get("/add/1/1");
+            REQUIRE(co_await resp->read_body() == "2");
+            auto second = co_await client.connect(endpoint);
+            resp = co_await second.get("/add/1/1");
+            REQUIRE(resp->status == http::status::HTTP_STATUS_SERVICE_UNAVAILABLE);
+            REQUIRE(server.stats().rejected_peer_connections == 1);
+            REQUIRE(server.stats().connections == 1);
+        });
+    }
+}
+
+using slow_controller_def = http::route_controller<R"(/slow)",
+    session,
+    http::string_request,
+    struct slow_controller>;
+
+struct slow_controller : slow_controller_def
+{
+    using slow_controller_def::slow_controller_def;
+
+    auto on_get() -> task<http::string_response> {
+        co_await service().schedule_after(std::chrono::milliseconds{200});
+        co_return http::string_response{http::status::HTTP_STATUS_OK, "slow"};
+    }
+};
+
+SCENARIO("servers holding requests back can be stopped", "[cppcoro-http][router][admission]") {
+    cppcoro::io_service ios;
+    GIVEN("A server processing one request at a time") {
+        http::controller_server<session, slow_controller> server{ios, test::any_port};
+        server.limits({.max_requests = 1});
+
+        WHEN("It is stopped while requests wait for the slot") {
+            test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+                const std::string_view request = "GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n";
+                std::vector<net::socket> sockets;
+                for (int ii = 0; ii < 3; ++ii) {
+                    auto &sock = sockets.emplace_back(net::create_tcp_socket<false>(ios, endpoint));
+                    co_await sock.connect(endpoint);
+                    co_await sock.send(request.data(), request.size());
+                }
+                while (server.stats().paused_requests < 2) {
+                    co_await ios.schedule_after(std::chrono::milliseconds{10});
+                }
+            });
+            THEN("Every waiting request is released") {
+                REQUIRE(server.stats().requests == 0);
+                REQUIRE(server.stats().connections == 0);
+            }
+        }
     }
 }
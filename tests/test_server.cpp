@@ -10,6 +10,9 @@
 #include <cppcoro/when_all.hpp>
 #include <cppcoro/on_scope_exit.hpp>
 #include <cppcoro/http/route_controller.hpp>
+
+#include "serve.hpp"
+
 #include <thread>
 
 using namespace cppcoro;
@@ -17,7 +20,6 @@ using namespace cppcoro;
 namespace rng = std::ranges;
 
 constexpr auto test_thread_count = 3;
-constexpr auto test_endpoint = "127.0.0.1:4242";
 
 SCENARIO("echo server should work", "[cppcoro-http][server][echo]") {
     http::logging::log_level = spdlog::level::debug;
@@ -41,7 +43,7 @@ SCENARIO("echo server should work", "[cppcoro-http][server][echo]") {
         }
     };
     using echo_server = http::controller_server<session, echo_controller>;
-    echo_server server{ios, *net::ip_endpoint::from_string(test_endpoint)};
+    echo_server server{ios, test::any_port};
     std::vector<std::thread> tp{test_thread_count};
     auto start_threads = [&tp, &ios] {
         rng::generate(tp, [&ios] {
@@ -69,13 +71,13 @@ SCENARIO("echo server should work", "[cppcoro-http][server][echo]") {
                 auto _ = on_scope_exit([&] {
                     server.stop();
                 });
-                auto conn = co_await client.connect(*net::ip_endpoint::from_string(test_endpoint));
+                auto conn = co_await client.connect(server.local_endpoint());
                 auto response = co_await conn.get("/echo", "hello");
                 REQUIRE(response->status == http::status::HTTP_STATUS_OK);
                 REQUIRE(co_await response->read_body() == "hello");
             }(),
 //            [&]() -> task<> {
-//                auto conn = co_await client.connect(*net::ip_endpoint::from_string(test_endpoint));
+//                auto conn = co_await client.connect(server.local_endpoint());
 //                auto response = co_await conn.get("/echo", "olleh");
 //                REQUIRE(response->status == http::status::HTTP_STATUS_OK);
 //                REQUIRE(co_await response->read_body() == "olleh");
@@ -0,0 +1,149 @@
+#define CATCH_CONFIG_MAIN
+
+#include <catch2/catch.hpp>
+
+#include <cppcoro/http/route_controller.hpp>
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/when_all.hpp>
+#include <cppcoro/on_scope_exit.hpp>
+#include <cppcoro/cancellation_source.hpp>
+#include <cppcoro/operation_cancelled.hpp>
+
+#include "serve.hpp"
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+using namespace cppcoro;
+using namespace std::chrono_literals;
+
+struct session
+{
+};
+
+using hello_controller_def = http::route_controller<R"(/hello/(\w+))",
+    session,
+    http::string_request,
+    struct hello_controller>;
+
+struct hello_controller : hello_controller_def
+{
+    using hello_controller_def::hello_controller_def;
+
+    auto on_get(std::string_view who) -> task<http::string_response> {
+        co_return http::string_response{http::status::HTTP_STATUS_OK, std::string{who}};
+    }
+};
+
+namespace {
+    /**
+     * Raw client socket: sends what the test wants, however incomplete.
+     */
+    struct raw_client
+    {
+        io_service &ios;
+        net::socket sock = net::create_tcp_socket<false>(ios, test::any_port);
+
+        task<> send(std::string_view data) {
+            while (not data.empty()) {
+                data.remove_prefix(co_await sock.send(data.data(), data.size()));
+            }
+        }
+
+        /**
+         * Read until the server closes the connection (or @a limit elapses), returns what was received.
+         */
+        task<std::string> read_until_closed(std::chrono::milliseconds limit) {
+            cancellation_source timeout;
+            std::string received;
+            (void) co_await when_all(
+                [&]() -> task<> {
+                    auto _ = on_scope_exit([&] {
+                        timeout.request_cancellation();
+                    });
+                    std::array<char, 1024> buffer;
+                    try {
+                        while (auto size = co_await sock.recv(buffer.data(), buffer.size(), timeout.token())) {
+                            received.append(buffer.data(), size);
+                        }
+                    } catch (operation_cancelled &) {
+                        received.append("<still open>");
+                    }
+                }(),
+                [&]() -> task<> {
+                    try {
+                        co_await ios.schedule_after(limit, timeout.token());
+                    } catch (operation_cancelled &) {}
+                    timeout.request_cancellation();
+                }());
+            co_return received;
+        }
+    };
+
+    /**
+     * Run @a client_fn against a hello server configured with @a timeouts, returns its result.
+     */
+    template<typename ClientFnT>
+    std::string with_server(const tcp::server_timeouts &timeouts, ClientFnT client_fn) {
+        io_service ios;
+        http::controller_server<session, hello_controller> server{ios, test::any_port};
+        server.timeouts(timeouts);
+        std::string result;
+        test::serve(ios, server, [&](const net::ip_endpoint &endpoint) -> task<> {
+            raw_client client{ios};
+            co_await client.sock.connect(endpoint);
+            result = co_await client_fn(client);
+        });
+        return result;
+    }
+}
+
+SCENARIO("server connections stalling mid-head are closed", "[cppcoro-http][timeouts]") {
+    GIVEN("A server with a header timeout") {
+        const tcp::server_timeouts timeouts{.header = 300ms};
+        WHEN("A client sends part of a request head then stalls") {
+            const auto start = std::chrono::steady_clock::now();
+            const auto received = with_server(timeouts, [](raw_client &client) -> task<std::string> {
+                co_await client.send("GET /hello/world HTTP/1.1\r\nHost: localhost\r\n");
+                co_return co_await client.read_until_closed(5s);
+            });
+            THEN("The connection is closed once the head deadline is over, without response") {
+                REQUIRE(received.empty());
+                REQUIRE(std::chrono::steady_clock::now() - start >= 300ms);
+            }
+        }
+    }
+}
+
+SCENARIO("idle server connections are closed", "[cppcoro-http][timeouts]") {
+    GIVEN("A server with an idle timeout") {
+        const tcp::server_timeouts timeouts{.idle = 300ms};
+        WHEN("A client stops sending after a request") {
+            const auto start = std::chrono::steady_clock::now();
+            const auto received = with_server(timeouts, [](raw_client &client) -> task<std::string> {
+                co_await client.send("GET /hello/world HTTP/1.1\r\nHost: localhost\r\n\r\n");
+                co_return co_await client.read_until_closed(5s);
+            });
+            THEN("The request is answered and the connection closed after the idle timeout") {
+                REQUIRE(received.starts_with("HTTP/1.1 200"));
+                REQUIRE(received.ends_with("world"));
+                REQUIRE(std::chrono::steady_clock::now() - start >= 300ms);
+            }
+        }
+    }
+    GIVEN("A server with default timeouts") {
+        WHEN("A client stays idle after a request") {
+            const auto received = with_server({}, [](raw_client &client) -> task<std::string> {
+                co_await client.send("GET /hello/world HTTP/1.1\r\nHost: localhost\r\n\r\n");
+                co_return co_await client.read_until_closed(1s);
+            });
+            THEN("The connection is left open") {
+                REQUIRE(received.starts_with("HTTP/1.1 200"));
+                REQUIRE(received.ends_with("<still open>"));
+            }
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <cppcoro/details/timer_wheel.hpp>
+#include <cppcoro/sync_wait.hpp>
+#include <cppcoro/task.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include <array>
+
+using namespace cppcoro;
+using namespace std::chrono_literals;
+
+SCENARIO("timer wheels should expire timers on time", "[cppcoro-http][timer_wheel]") {
+    GIVEN("A timer wheel and some timers") {
+        detail::timer_wheel wheel{1ms};
+        const auto start = detail::timer_wheel::clock::now();
+        std::array<cancellation_source, 3> sources;
+        detail::timer_wheel::timer short_timer{sources[0]};
+        detail::timer_wheel::timer long_timer{sources[1]};
+        detail::timer_wheel::timer disarmed_timer{sources[2]};
+        wheel.arm(short_timer, 10ms);
+        wheel.arm(long_timer, 5s); // lives in an upper level
+        wheel.arm(disarmed_timer, 20ms);
+        wheel.disarm(disarmed_timer);
+        REQUIRE(wheel.size() == 2);
+        WHEN("Time goes by") {
+            wheel.advance(start + 5ms);
+            THEN("Timers do not expire early") {
+                REQUIRE_FALSE(sources[0].is_cancellation_requested());
+            }
+            wheel.advance(start + 1s);
+            THEN("Expired timers cancel their source") {
+                REQUIRE(sources[0].is_cancellation_requested());
+                REQUIRE_FALSE(short_timer.armed());
+                REQUIRE_FALSE(sources[1].is_cancellation_requested());
+                REQUIRE_FALSE(sources[2].is_cancellation_requested());
+            }
+            wheel.advance(start + 6s);
+            THEN("Timers of upper levels expire too") {
+                REQUIRE(sources[1].is_cancellation_requested());
+                REQUIRE_FALSE(sources[2].is_cancellation_requested());
+                REQUIRE(wheel.size() == 0);
+            }
+        }
+        WHEN("A timer is re-armed") {
+            wheel.arm(short_timer, 1s);
+            wheel.advance(start + 500ms);
+            THEN("Its previous deadline is forgotten") {
+                REQUIRE_FALSE(sources[0].is_cancellation_requested());
+                REQUIRE(short_timer.armed());
+            }
+        }
+        WHEN("A timer is armed at a deadline already past") {
+            wheel.arm_at(short_timer, start - 1s);
+            wheel.advance(detail::timer_wheel::clock::now() + 1ms);
+            THEN("It expires on the next tick") {
+                REQUIRE(sources[0].is_cancellation_requested());
+            }
+        }
+    }
+}
+
+SCENARIO("timer wheels should signal their first timer", "[cppcoro-http][timer_wheel]") {
+    GIVEN("An empty timer wheel and a ticker waiting for it") {
+        detail::timer_wheel wheel{1ms};
+        std::array<cancellation_source, 2> sources;
+        detail::timer_wheel::timer first_timer{sources[0]};
+        detail::timer_wheel::timer second_timer{sources[1]};
+        size_t wake_ups = 0;
+        auto ticker = [&]() -> task<> {
+            co_await wheel.armed();
+            ++wake_ups;
+        };
+        WHEN("Timers are armed") {
+            sync_wait(when_all(ticker(), [&]() -> task<> {
+                wheel.arm(first_timer, 10ms);
+                wheel.arm(second_timer, 10ms);
+                co_return;
+            }()));
+            THEN("The ticker is woken up by the first one") {
+                REQUIRE(wake_ups == 1);
+                REQUIRE(wheel.size() == 2);
+            }
+        }
+    }
+}
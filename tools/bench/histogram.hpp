@@ -0,0 +1,188 @@
+/**
+ * @file tools/bench/histogram.hpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ */
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bench {
+
+    /**
+     * @brief HdrHistogram-style latency histogram.
+     *
+     * Values are counted in log-linear buckets: recording is O(1) with a fixed memory footprint, and any
+     * recorded value is reported with @a significant_digits decimal digits of precision.
+     */
+    class histogram
+    {
+    public:
+        explicit histogram(uint64_t highest_trackable = 3'600'000'000, int significant_digits = 3) {
+            const auto largest_single_unit = 2 * uint64_t(std::pow(10, significant_digits));
+            sub_bucket_count_magnitude_ = std::bit_width(largest_single_unit - 1);
+            sub_bucket_half_count_magnitude_ = sub_bucket_count_magnitude_ - 1;
+            sub_bucket_count_ = uint64_t(1) << sub_bucket_count_magnitude_;
+            sub_bucket_half_count_ = sub_bucket_count_ / 2;
+            sub_bucket_mask_ = sub_bucket_count_ - 1;
+
+            highest_trackable_ = std::max(highest_trackable, 2 * sub_bucket_count_);
+            size_t bucket_count = 1;
+            for (auto smallest_untrackable = sub_bucket_count_; smallest_untrackable <= highest_trackable_;
+                 smallest_untrackable <<= 1) {
+                ++bucket_count;
+            }
+            counts_.resize((bucket_count + 1) * sub_bucket_half_count_);
+        }
+
+        void record(uint64_t value, uint64_t count = 1) {
+            value = std::min(value, highest_trackable_);
+            counts_[index_of(value)] += count;
+            total_ += count;
+            min_ = std::min(min_, value);
+            max_ = std::max(max_, value);
+        }
+
+        /**
+         * @brief Record @a value, back-filling the samples a stalled load generator failed to take.
+         *
+         * When a response takes longer than @a expected_interval, the requests that would have been sent
+         * meanwhile would have waited too: they are recorded as well, with linearly decreasing latencies.
+         */
+        void record_corrected(uint64_t value, uint64_t expected_interval, uint64_t count = 1) {
+            record(value, count);
+            if (expected_interval == 0) {
+                return;
+            }
+            for (auto missing = value > expected_interval ? value - expected_interval : 0;
+                 missing >= expected_interval; missing -= expected_interval) {
+                record(missing, count);
+            }
+        }
+
+        /**
+         * @brief Copy of this histogram corrected for coordinated omission.
+         */
+        [[nodiscard]] histogram corrected(uint64_t expected_interval) const {
+            histogram result{*this};
+            result.reset();
+            for (size_t index = 0; index < counts_.size(); ++index) {
+                if (counts_[index]) {
+                    result.record_corrected(value_at(index), expected_interval, counts_[index]);
+                }
+            }
+            return result;
+        }
+
+        void merge(const histogram &other) {
+            for (size_t index = 0; index < other.counts_.size(); ++index) {
+                if (other.counts_[index]) {
+                    record(other.value_at(index), other.counts_[index]);
+                }
+            }
+        }
+
+        void reset() {
+            std::fill(counts_.begin(), counts_.end(), 0);
+            total_ = 0;
+            min_ = UINT64_MAX;
+            max_ = 0;
+        }
+
+        [[nodiscard]] uint64_t count() const noexcept {
+            return total_;
+        }
+
+        [[nodiscard]] uint64_t min() const noexcept {
+            return total_ ? lowest_equivalent(min_) : 0;
+        }
+
+        [[nodiscard]] uint64_t max() const noexcept {
+            return total_ ? highest_equivalent(max_) : 0;
+        }
+
+        [[nodiscard]] double mean() const noexcept {
+            if (total_ == 0) {
+                return 0;
+            }
+            double sum = 0;
+            for (size_t index = 0; index < counts_.size(); ++index) {
+                if (counts_[index]) {
+                    sum += double(median_equivalent(value_at(index))) * double(counts_[index]);
+                }
+            }
+            return sum / double(total_);
+        }
+
+        /**
+         * @brief Value at @a percentile (0-100): @a percentile % of the recorded values are less or equal.
+         */
+        [[nodiscard]] uint64_t value_at_percentile(double percentile) const noexcept {
+            const auto target = std::max<uint64_t>(
+                1, uint64_t(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * double(total_))));
+            uint64_t cumulative = 0;
+            for (size_t index = 0; index < counts_.size(); ++index) {
+                cumulative += counts_[index];
+                if (cumulative >= target) {
+                    return highest_equivalent(value_at(index));
+                }
+            }
+            return max();
+        }
+
+    private:
+        [[nodiscard]] size_t bucket_index(uint64_t value) const noexcept {
+            // highest power of two of value | mask, less the sub bucket magnitude
+            return size_t(std::bit_width(value | sub_bucket_mask_)) - sub_bucket_count_magnitude_;
+        }
+
+        [[nodiscard]] size_t index_of(uint64_t value) const noexcept {
+            const auto bucket = bucket_index(value);
+            const auto sub_bucket = size_t(value >> bucket);
+            return ((bucket + 1) << sub_bucket_half_count_magnitude_) + sub_bucket - sub_bucket_half_count_;
+        }
+
+        [[nodiscard]] uint64_t value_at(size_t index) const noexcept {
+            auto bucket = int64_t(index >> sub_bucket_half_count_magnitude_) - 1;
+            auto sub_bucket = (index & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+            if (bucket < 0) {
+                sub_bucket -= sub_bucket_half_count_;
+                bucket = 0;
+            }
+            return uint64_t(sub_bucket) << bucket;
+        }
+
+        [[nodiscard]] uint64_t equivalent_range(uint64_t value) const noexcept {
+            const auto bucket = bucket_index(value);
+            const auto sub_bucket = value >> bucket;
+            return uint64_t(1) << (sub_bucket >= sub_bucket_count_ ? bucket + 1 : bucket);
+        }
+
+        [[nodiscard]] uint64_t lowest_equivalent(uint64_t value) const noexcept {
+            const auto bucket = bucket_index(value);
+            return (value >> bucket) << bucket;
+        }
+
+        [[nodiscard]] uint64_t highest_equivalent(uint64_t value) const noexcept {
+            return lowest_equivalent(value) + equivalent_range(value) - 1;
+        }
+
+        [[nodiscard]] uint64_t median_equivalent(uint64_t value) const noexcept {
+            return lowest_equivalent(value) + equivalent_range(value) / 2;
+        }
+
+        size_t sub_bucket_count_magnitude_;
+        size_t sub_bucket_half_count_magnitude_;
+        uint64_t sub_bucket_count_;
+        uint64_t sub_bucket_half_count_;
+        uint64_t sub_bucket_mask_;
+        uint64_t highest_trackable_;
+        std::vector<uint64_t> counts_;
+        uint64_t total_ = 0;
+        uint64_t min_ = UINT64_MAX;
+        uint64_t max_ = 0;
+    };
+}
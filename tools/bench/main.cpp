@@ -0,0 +1,288 @@
+/**
+ * @file tools/bench/main.cpp
+ * @author Sylvain Garcia <garcia.6l20@gmail.com>
+ *
+ * wrk-like HTTP load generator built on http::client.
+ */
+#include "histogram.hpp"
+
+#include <cppcoro/http/http_client.hpp>
+#include <cppcoro/http/runtime.hpp>
+#include <cppcoro/io_service.hpp>
+#include <cppcoro/when_all.hpp>
+
+#include <lyra/cli_parser.hpp>
+#include <lyra/help.hpp>
+#include <lyra/opt.hpp>
+#include <lyra/arg.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cppcoro;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+    struct request_spec
+    {
+        http::method method = http::method::get;
+        std::string path = "/";
+    };
+
+    struct bench_settings
+    {
+        net::ip_endpoint endpoint;
+        size_t connections = 16;
+        size_t depth = 1; // pipelined requests per connection
+        std::chrono::seconds duration{10};
+        double rate = 0; // requests per second, 0: as fast as possible
+        std::string body; // sent with POST requests
+        std::vector<request_spec> mix; // each request appears as many times as its weight
+    };
+
+    struct shard_result
+    {
+        bench::histogram latency; // microseconds
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+        uint64_t connect_errors = 0;
+    };
+
+    /**
+     * Parse METHOD:PATH[:WEIGHT] (ie.: GET:/hello/world:3).
+     */
+    bool parse_request(std::string_view input, std::vector<request_spec> &mix) {
+        auto first = input.find(':');
+        if (first == std::string_view::npos) {
+            return false;
+        }
+        request_spec spec;
+        const auto method = input.substr(0, first);
+        if (method == "GET") {
+            spec.method = http::method::get;
+        } else if (method == "POST") {
+            spec.method = http::method::post;
+        } else {
+            return false;
+        }
+        auto path = input.substr(first + 1);
+        size_t weight = 1;
+        if (auto last = path.rfind(':'); last != std::string_view::npos and last != 0) {
+            const auto weight_str = path.substr(last + 1);
+            if (std::from_chars(weight_str.data(), weight_str.data() + weight_str.size(), weight).ec != std::errc{}
+                or weight == 0) {
+                return false;
+            }
+            path = path.substr(0, last);
+        }
+        spec.path = path;
+        mix.insert(mix.end(), weight, spec);
+        return true;
+    }
+
+    /**
+     * One pipeline slot: issue requests on @a conn until @a deadline.
+     *
+     * With a target rate, requests are sent on schedule and latency is measured from the time a request
+     * was due, not from when it was actually sent: a stalled server cannot hide the requests it delayed.
+     */
+    task<> run_slot(http::client::connection_type &conn, io_service &service, const bench_settings &settings,
+                    size_t slot, shard_result &result, clock_type::time_point deadline,
+                    clock_type::duration interval) {
+        auto due = clock_type::now();
+        for (size_t ii = slot; clock_type::now() < deadline; ++ii) {
+            const auto &spec = settings.mix[ii % settings.mix.size()];
+            if (interval.count()) {
+                if (auto now = clock_type::now(); due > now) {
+                    co_await service.schedule_after(due - now);
+                }
+            } else {
+                due = clock_type::now();
+            }
+            auto response = spec.method == http::method::post
+                            ? co_await conn.post(std::string{spec.path}, std::string{settings.body})
+                            : co_await conn.get(std::string{spec.path});
+            const auto latency = clock_type::now() - due;
+            if (not response) {
+                ++result.errors;
+                co_return; // connection closed
+            }
+            if (int(response->status) >= 400) {
+                ++result.errors;
+            }
+            result.bytes += (co_await response->read_body()).size();
+            result.latency.record(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+            ++result.requests;
+            due += interval;
+        }
+    }
+
+    task<> run_connection(http::client &client, io_service &service, const bench_settings &settings,
+                          size_t first_slot, shard_result &result, clock_type::time_point deadline,
+                          clock_type::duration interval) {
+        std::optional<http::client::connection_type> conn;
+        try {
+            conn.emplace(co_await client.connect(settings.endpoint));
+        } catch (std::exception &) {
+            ++result.connect_errors;
+            co_return;
+        }
+        std::vector<task<>> slots;
+        for (size_t slot = 0; slot < settings.depth; ++slot) {
+            slots.push_back(run_slot(*conn, service, settings, first_slot + slot, result, deadline, interval));
+        }
+        try {
+            co_await when_all(std::move(slots));
+        } catch (std::exception &) {
+            ++result.errors;
+        }
+    }
+
+    void print_latency(std::string_view title, const bench::histogram &latency) {
+        fmt::print("  {}\n", title);
+        fmt::print("    {:>8} {:>10.2f}ms\n", "mean", latency.mean() / 1000.);
+        for (double percentile : {50., 75., 90., 99., 99.9, 99.99, 100.}) {
+            fmt::print("    {:>7}% {:>10.2f}ms\n", percentile, double(latency.value_at_percentile(percentile)) / 1000.);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bool show_help = false;
+    std::string endpoint_input = "127.0.0.1:4242";
+    uint32_t thread_count = std::thread::hardware_concurrency();
+    uint32_t connections = 16;
+    uint32_t depth = 1;
+    uint32_t duration = 10;
+    double rate = 0;
+    uint32_t expected_interval = 0;
+    std::string body;
+    std::vector<std::string> requests;
+    auto cli
+        = lyra::help(show_help)
+          | lyra::opt(thread_count, "threads")
+          ["-t"]["--threads"]
+              ("Thread count")
+          | lyra::opt(connections, "connections")
+          ["-c"]["--connections"]
+              ("Open connections, shared between threads")
+          | lyra::opt(depth, "depth")
+          ["-p"]["--pipeline"]
+              ("Requests in flight per connection")
+          | lyra::opt(duration, "seconds")
+          ["-d"]["--duration"]
+              ("Test duration")
+          | lyra::opt(rate, "requests/s")
+          ["-R"]["--rate"]
+              ("Target throughput (default: as fast as possible)")
+          | lyra::opt(expected_interval, "microseconds")
+          ["-i"]["--interval"]
+              ("Expected interval between two requests of a pipeline slot, to correct closed-loop latencies "
+               "for coordinated omission (default: no correction, implied by --rate)")
+          | lyra::opt(requests, "METHOD:PATH[:WEIGHT]")
+          ["-r"]["--request"]
+              ("Request mix entry, ie.: GET:/hello/world:3 (default: GET:/)")
+          | lyra::opt(body, "body")
+          ["-b"]["--body"]
+              ("Body of POST requests")
+          | lyra::arg(endpoint_input, "endpoint")
+              ("Server endpoint");
+    auto result = cli.parse({argc, argv});
+    if (!result) {
+        std::cerr << "Error in command line: " << result.errorMessage() << std::endl;
+        exit(1);
+    }
+    if (show_help) {
+        std::cout << cli << std::endl;
+        return 0;
+    }
+
+    bench_settings settings;
+    if (auto endpoint = net::ip_endpoint::from_string(endpoint_input); endpoint) {
+        settings.endpoint = *endpoint;
+    } else {
+        std::cerr << "Invalid endpoint: " << endpoint_input << std::endl;
+        exit(1);
+    }
+    thread_count = std::clamp(thread_count, 1u, 256u);
+    settings.connections = std::max<size_t>(connections, 1);
+    if (thread_count > settings.connections) {
+        std::cerr << "Only " << settings.connections << " connections: running " << settings.connections
+                  << " threads instead of " << thread_count << std::endl;
+        thread_count = uint32_t(settings.connections);
+    }
+    settings.depth = std::max<size_t>(depth, 1);
+    settings.duration = std::chrono::seconds{std::max<uint32_t>(duration, 1)};
+    settings.rate = rate;
+    settings.body = body;
+    for (auto &request : requests) {
+        if (not parse_request(request, settings.mix)) {
+            std::cerr << "Invalid request: " << request << std::endl;
+            exit(1);
+        }
+    }
+    if (settings.mix.empty()) {
+        settings.mix.emplace_back();
+    }
+
+    const auto slot_count = settings.connections * settings.depth;
+    const auto interval = settings.rate > 0
+                          ? std::chrono::duration_cast<clock_type::duration>(
+                              std::chrono::duration<double>{double(slot_count) / settings.rate})
+                          : clock_type::duration{};
+
+    fmt::print("Running {}s test @ {}\n", settings.duration.count(), settings.endpoint.to_string());
+    fmt::print("  {} threads, {} connections, pipeline depth {}\n", thread_count, settings.connections,
+               settings.depth);
+
+    http::runtime runtime{thread_count};
+    std::vector<shard_result> results(runtime.size());
+    const auto start = clock_type::now();
+    const auto deadline = start + settings.duration;
+    runtime.run([&](io_service &service, size_t index) -> task<> {
+        http::client client{service};
+        auto &result = results[index];
+        std::vector<task<>> connections;
+        for (auto conn = index; conn < settings.connections; conn += runtime.size()) {
+            connections.push_back(run_connection(client, service, settings, conn * settings.depth, result,
+                                                 deadline, interval));
+        }
+        co_await when_all(std::move(connections));
+    });
+    const auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    shard_result total;
+    for (auto &shard : results) {
+        total.latency.merge(shard.latency);
+        total.requests += shard.requests;
+        total.errors += shard.errors;
+        total.bytes += shard.bytes;
+        total.connect_errors += shard.connect_errors;
+    }
+
+    fmt::print("  {} requests in {:.2f}s, {:.2f}MB read\n", total.requests, elapsed, double(total.bytes) / 1e6);
+    if (total.errors or total.connect_errors) {
+        fmt::print("  errors: {} requests, {} connections\n", total.errors, total.connect_errors);
+    }
+    fmt::print("Requests/sec: {:.2f}\n", double(total.requests) / elapsed);
+    if (interval.count()) {
+        // measured from when each request was due: already free of coordinated omission
+        print_latency("Latency (corrected at the source)", total.latency);
+    } else {
+        print_latency("Latency", total.latency);
+        if (expected_interval) {
+            print_latency("Latency (corrected for coordinated omission)", total.latency.corrected(expected_interval));
+        }
+    }
+    return 0;
+}